@@ -2,9 +2,11 @@
 
 in vec3 fColor;
 
+uniform vec4 uColor;
+
 out vec4 frag_color;
 
 void main(void) {
-	frag_color = vec4(0.0, 1.0, 0.0, 1.0);
+	frag_color = uColor;
 	//frag_color = vec4(fColor, 1.0);
 }
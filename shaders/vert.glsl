@@ -1,11 +1,15 @@
 #version 420 core
 
-layout (location = 0) in vec3 vPos;
+// Grid-space fixed-point position (see vertex_t), mapped to NDC here.
+layout (location = 0) in vec2 vPos;
 layout (location = 1) in vec3 vColor;
 
+uniform vec2 uScale;
+uniform vec2 uOffset;
+
 out vec3 fColor;
 
 void main(void) {
 	fColor = vColor;
-	gl_Position = vec4(vPos, 1.0);
+	gl_Position = vec4(vPos * uScale + uOffset, 0.0, 1.0);
 }
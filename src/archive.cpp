@@ -0,0 +1,349 @@
+#include "archive.hpp"
+#include "raster.hpp"
+
+#include <chrono>
+#include <cstring>
+
+static inline uint32_t zigzag(int32_t v){
+	return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u){
+	return static_cast<int32_t>(u >> 1) ^ -static_cast<int32_t>(u & 1);
+}
+
+static inline uint8_t* putVarint(uint8_t *p, uint32_t v){
+	while(v >= 0x80){
+		*p++ = static_cast<uint8_t>(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = static_cast<uint8_t>(v);
+	return p;
+}
+
+// False if the varint runs past end or beyond 32 bits.
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v){
+	v = 0;
+	for(int shift = 0; shift < 35 && p < end; shift += 7){
+		const uint8_t b = *p++;
+		v |= static_cast<uint32_t>(b & 0x7F) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static inline uint32_t vertexKey(const vertex_t &v){
+	return static_cast<uint32_t>(v.x) << 16 | v.y;
+}
+
+ContourCodec::ContourCodec() {}
+
+// Each lattice midpoint is shared by the two cells on either side of its edge,
+// so a position has at most two endpoints and an open-addressed table pairs
+// them in one pass. Anything else (a third endpoint, a segment ending where it
+// starts) is simply left unpaired and becomes a polyline of its own.
+void ContourCodec::link(const vertex_t *verts, size_t count){
+	size_t size = 16;
+	while(size < 2 * count)
+		size *= 2;
+	const uint32_t mask = static_cast<uint32_t>(size - 1);
+	int bits = 0;
+	while((size_t(1) << bits) < size)
+		bits++;
+	table.assign(size, 0);
+	partner.assign(count, -1);
+	for(size_t k = 0; k < count; k++){
+		const uint32_t key = vertexKey(verts[k]);
+		uint32_t h = (key * 2654435761u) >> (32 - bits);
+		for(;; h = (h + 1) & mask){
+			if(table[h] == 0){
+				table[h] = static_cast<uint32_t>(k + 1);
+				break;
+			}
+			const uint32_t e = table[h] - 1;
+			if(vertexKey(verts[e]) != key)
+				continue;
+			if(partner[e] < 0 && e / 2 != k / 2){
+				partner[e] = static_cast<int32_t>(k);
+				partner[k] = static_cast<int32_t>(e);
+			} else {
+				table[h] = static_cast<uint32_t>(k + 1);
+			}
+			break;
+		}
+	}
+}
+
+int ContourCodec::encode(const vertex_t *verts, size_t count, std::vector<uint8_t> &out){
+	count &= ~static_cast<size_t>(1);
+	// Midpoints never use the lowest sub-cell bits; drop the ones no vertex sets.
+	uint32_t used = 0;
+	for(size_t k = 0; k < count; k++)
+		used |= verts[k].x | verts[k].y;
+	int unitShift = 0;
+	while(unitShift < 15 && !(used & (1u << unitShift)))
+		unitShift++;
+	if(count == 0)
+		unitShift = 0;
+
+	link(verts, count);
+	visited.assign(count / 2, 0);
+
+	// At most one varint count per segment plus a vertex per endpoint.
+	const size_t begin = out.size();
+	growBuffer(out, begin + (count / 2) * 5 + count * 10 + 1);
+	uint8_t *p = out.data() + begin;
+	int32_t px = 0, py = 0;
+	// The polyline starting at endpoint e: its vertex count, then its vertices.
+	auto walk = [&](uint32_t e){
+		chain.clear();
+		chain.push_back(e);
+		for(;;){
+			visited[e / 2] = 1;
+			chain.push_back(e ^ 1);
+			const int32_t next = partner[e ^ 1];
+			if(next < 0 || visited[next / 2])
+				break;
+			e = next;
+		}
+		p = putVarint(p, static_cast<uint32_t>(chain.size()));
+		for(uint32_t k : chain){
+			const int32_t x = verts[k].x >> unitShift, y = verts[k].y >> unitShift;
+			p = putVarint(p, zigzag(x - px));
+			p = putVarint(p, zigzag(y - py));
+			px = x;
+			py = y;
+		}
+	};
+	// Open chains from a free end first, then the closed loops, which end on
+	// their first vertex again.
+	for(size_t k = 0; k < count; k++)
+		if(partner[k] < 0 && !visited[k / 2])
+			walk(static_cast<uint32_t>(k));
+	for(size_t k = 0; k < count; k += 2)
+		if(!visited[k / 2])
+			walk(static_cast<uint32_t>(k));
+	*p++ = 0;
+	out.resize(p - out.data());
+	return unitShift;
+}
+
+bool ContourCodec::decode(const uint8_t *data, size_t bytes, int unitShift, size_t segments, std::vector<vertex_t> &out){
+	growBuffer(out, segments * 2);
+	vertex_t *dst = out.data();
+	vertex_t *const dstEnd = dst + segments * 2;
+	const uint8_t *p = data;
+	const uint8_t *const end = data + bytes;
+	const int32_t limit = 0xFFFF >> unitShift;
+	int32_t x = 0, y = 0;
+	for(;;){
+		uint32_t m, u, v;
+		if(!getVarint(p, end, m))
+			return false;
+		if(m == 0)
+			break;
+		if(m < 2 || m - 1 > static_cast<size_t>(dstEnd - dst) / 2 || !getVarint(p, end, u) || !getVarint(p, end, v))
+			return false;
+		x += unzigzag(u);
+		y += unzigzag(v);
+		if(x < 0 || y < 0 || x > limit || y > limit)
+			return false;
+		vertex_t prev = {static_cast<uint16_t>(x << unitShift), static_cast<uint16_t>(y << unitShift)};
+		for(uint32_t left = m - 1; left > 0; left--){
+			// Deltas of one lattice step are single bytes: take four
+			// vertices at once while the next eight bytes are all short.
+			if(left >= 4 && end - p >= 8){
+				uint64_t word;
+				memcpy(&word, p, sizeof(word));
+				if(!(word & UINT64_C(0x8080808080808080))){
+					for(int b = 0; b < 8; b += 2){
+						x += unzigzag(p[b]);
+						y += unzigzag(p[b + 1]);
+						if(x < 0 || y < 0 || x > limit || y > limit)
+							return false;
+						const vertex_t cur = {static_cast<uint16_t>(x << unitShift), static_cast<uint16_t>(y << unitShift)};
+						*dst++ = prev;
+						*dst++ = cur;
+						prev = cur;
+					}
+					p += 8;
+					left -= 3;
+					continue;
+				}
+			}
+			if(!getVarint(p, end, u) || !getVarint(p, end, v))
+				return false;
+			x += unzigzag(u);
+			y += unzigzag(v);
+			if(x < 0 || y < 0 || x > limit || y > limit)
+				return false;
+			const vertex_t cur = {static_cast<uint16_t>(x << unitShift), static_cast<uint16_t>(y << unitShift)};
+			*dst++ = prev;
+			*dst++ = cur;
+			prev = cur;
+		}
+	}
+	return p == end && dst == dstEnd;
+}
+
+ArchiveWriter::ArchiveWriter() : file(nullptr), offset(0), rawBytes(0), encodeSeconds(0.0), error(false) {}
+
+ArchiveWriter::~ArchiveWriter(){
+	if(file)
+		close();
+}
+
+bool ArchiveWriter::open(const char* path){
+	file = fopen(path, "wb");
+	if(!file){
+		fprintf(stderr, "ERROR: cannot open '%s' for writing\n", path);
+		return false;
+	}
+	uint8_t header[ARCHIVE_HEADER_BYTES] = { 'M', 'S', 'Q', 'C' };
+	writeLE32(header + 4, 1);
+	writeLE64(header + 8, 0);
+	error = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+	offset = sizeof(header);
+	return !error;
+}
+
+bool ArchiveWriter::append(const grid_t &grid, const std::vector<vertex_t> &verts){
+	if(!file)
+		return false;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	payload.resize(FRAME_HEADER_BYTES);
+	const int unitShift = codec.encode(verts.data(), verts.size(), payload);
+	uint8_t *header = payload.data();
+	writeLE32(header, static_cast<uint32_t>(payload.size() - FRAME_HEADER_BYTES));
+	writeLE32(header + 4, static_cast<uint32_t>(verts.size() / 2));
+	writeLE32(header + 8, grid.wQuads);
+	writeLE32(header + 12, grid.hQuads);
+	header[16] = static_cast<uint8_t>(grid.quantShift);
+	header[17] = static_cast<uint8_t>(unitShift);
+	header[18] = header[19] = 0;
+	encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if(!error && fwrite(payload.data(), 1, payload.size(), file) != payload.size())
+		error = true;
+	offsets.push_back(offset);
+	offset += payload.size();
+	rawBytes += (verts.size() & ~static_cast<size_t>(1)) * sizeof(vertex_t);
+	return !error;
+}
+
+bool ArchiveWriter::close(){
+	if(!file)
+		return false;
+	std::vector<uint8_t> index(4 + offsets.size() * 8);
+	writeLE32(index.data(), static_cast<uint32_t>(offsets.size()));
+	for(size_t k = 0; k < offsets.size(); k++)
+		writeLE64(index.data() + 4 + k * 8, offsets[k]);
+	uint8_t at[8];
+	writeLE64(at, offset);
+	if(!error && (fwrite(index.data(), 1, index.size(), file) != index.size() || fseek(file, 8, SEEK_SET) != 0
+			|| fwrite(at, 1, sizeof(at), file) != sizeof(at)))
+		error = true;
+	if(fclose(file) != 0)
+		error = true;
+	file = nullptr;
+	return !error;
+}
+
+int ArchiveWriter::getFrames() const {
+	return static_cast<int>(offsets.size());
+}
+
+uint64_t ArchiveWriter::getRawBytes() const {
+	return rawBytes;
+}
+
+uint64_t ArchiveWriter::getStoredBytes() const {
+	return offset;
+}
+
+double ArchiveWriter::getEncodeSeconds() const {
+	return encodeSeconds;
+}
+
+ArchiveReader::ArchiveReader() : file(nullptr), decodeSeconds(0.0) {}
+
+ArchiveReader::~ArchiveReader(){
+	if(file)
+		fclose(file);
+}
+
+bool ArchiveReader::open(const char* path){
+	file = fopen(path, "rb");
+	if(!file){
+		fprintf(stderr, "ERROR: cannot open '%s'\n", path);
+		return false;
+	}
+	uint8_t header[ARCHIVE_HEADER_BYTES];
+	if(fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "MSQC", 4) != 0 || readLE32(header + 4) != 1){
+		fprintf(stderr, "ERROR: '%s' is not a contour archive\n", path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	const uint64_t length = ftell(file);
+	const uint64_t indexOffset = readLE64(header + 8);
+	offsets.clear();
+	uint8_t count[4];
+	if(indexOffset != 0 && indexOffset + 4 <= length && fseek(file, indexOffset, SEEK_SET) == 0
+			&& fread(count, 1, sizeof(count), file) == sizeof(count) && indexOffset + 4 + readLE32(count) * UINT64_C(8) <= length){
+		std::vector<uint8_t> index(readLE32(count) * static_cast<size_t>(8));
+		if(fread(index.data(), 1, index.size(), file) == index.size()){
+			for(size_t k = 0; k < index.size(); k += 8)
+				offsets.push_back(readLE64(index.data() + k));
+			return true;
+		}
+	}
+	// Not closed: walk the frame headers up to the first incomplete frame.
+	const uint64_t framesEnd = indexOffset != 0 && indexOffset <= length ? indexOffset : length;
+	uint64_t at = ARCHIVE_HEADER_BYTES;
+	uint8_t frame[FRAME_HEADER_BYTES];
+	while(at + FRAME_HEADER_BYTES <= framesEnd && fseek(file, at, SEEK_SET) == 0 && fread(frame, 1, sizeof(frame), file) == sizeof(frame)){
+		const uint64_t next = at + FRAME_HEADER_BYTES + readLE32(frame);
+		if(next > framesEnd)
+			break;
+		offsets.push_back(at);
+		at = next;
+	}
+	fprintf(stderr, "WARNING: '%s' has no frame index, found %zu frames by scanning\n", path, offsets.size());
+	return true;
+}
+
+int ArchiveReader::getFrames() const {
+	return static_cast<int>(offsets.size());
+}
+
+bool ArchiveReader::read(int k, grid_t &grid, std::vector<vertex_t> &verts){
+	if(k < 0 || k >= getFrames())
+		return false;
+	uint8_t header[FRAME_HEADER_BYTES];
+	if(fseek(file, offsets[k], SEEK_SET) != 0 || fread(header, 1, sizeof(header), file) != sizeof(header))
+		return false;
+	const uint32_t bytes = readLE32(header);
+	const uint32_t segments = readLE32(header + 4);
+	grid.wQuads = readLE32(header + 8);
+	grid.hQuads = readLE32(header + 12);
+	grid.quantShift = header[16];
+	// Every segment takes at least two bytes, which bounds what a corrupt
+	// header can make us allocate.
+	if(grid.wQuads < 2 || grid.hQuads < 2 || grid.wQuads > MAX_GRID_CELLS + 1 || grid.hQuads > MAX_GRID_CELLS + 1
+			|| grid.quantShift < 1 || grid.quantShift > 8 || header[17] > 15 || segments > bytes / 2)
+		return false;
+	grid.quadWidth = 2.0f / static_cast<float>(grid.wQuads);
+	grid.quadHeight = 2.0f / static_cast<float>(grid.hQuads);
+	growBuffer(payload, bytes);
+	if(fread(payload.data(), 1, bytes, file) != bytes)
+		return false;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const bool ok = codec.decode(payload.data(), bytes, header[17], segments, verts);
+	decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return ok;
+}
+
+double ArchiveReader::getDecodeSeconds() const {
+	return decodeSeconds;
+}
@@ -0,0 +1,106 @@
+#ifndef __ARCHIVE_HPP__
+#define __ARCHIVE_HPP__
+
+#include "contour.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Contour archive layout (.msqc), all little-endian:
+//   0  char[4] magic "MSQC"
+//   4  uint32  version, 1
+//   8  uint64  offset of the frame index, zero until the archive is closed
+//   16 frames, each a FRAME_HEADER_BYTES header and its payload:
+//        uint32 payload bytes, uint32 segments, uint32 wQuads, uint32 hQuads,
+//        uint8 quantShift, uint8 unit shift, uint16 zero
+//   frame index: uint32 frame count, then the uint64 offset of every frame.
+// Without an index (e.g. the recording was killed) the frames are found by
+// walking the headers instead.
+//
+// A payload is the frame's segments chained into polylines, each a varint
+// vertex count and its vertices as zigzag varint x, y deltas, the first from
+// the previous polyline's last vertex ((0, 0) for the first), and a zero count
+// after the last. Closed loops end on their first vertex again. Vertices are
+// shifted right by the unit shift first, which drops the sub-cell bits they
+// never use: midpoints need one, so a step along the isoline is one byte per
+// axis.
+static const size_t ARCHIVE_HEADER_BYTES = 16;
+static const size_t FRAME_HEADER_BYTES = 20;
+
+// Encodes GL_LINES pairs as an archive payload and back. Scratch space is kept
+// between frames, so a steady stream of frames allocates nothing.
+class ContourCodec {
+	public:
+		ContourCodec();
+
+		// Appends the payload for verts[0 .. count) to out. Returns the unit
+		// shift, the sub-cell bits dropped without loss.
+		int encode(const vertex_t *verts, size_t count, std::vector<uint8_t> &out);
+		// Replaces out with the segments of a payload, as GL_LINES pairs.
+		// False if it is malformed or does not hold exactly segments.
+		bool decode(const uint8_t *data, size_t bytes, int unitShift, size_t segments, std::vector<vertex_t> &out);
+
+	private:
+		// Endpoint k is end k & 1 of segment k / 2; partner is the other
+		// endpoint at the same position, or -1.
+		void link(const vertex_t *verts, size_t count);
+
+		std::vector<int32_t> partner;
+		// Endpoint + 1 per slot, 0 when empty.
+		std::vector<uint32_t> table;
+		// Per segment, and the endpoints of the polyline being written.
+		std::vector<uint8_t> visited;
+		std::vector<uint32_t> chain;
+};
+
+// Appends frames to an archive and writes the index on close().
+class ArchiveWriter {
+	public:
+		ArchiveWriter();
+		~ArchiveWriter();
+
+		bool open(const char* path);
+		bool append(const grid_t &grid, const std::vector<vertex_t> &verts);
+		// Writes the index; false if any write failed.
+		bool close();
+
+		int getFrames() const;
+		// Bytes of the frames as vertex_t pairs, and as stored.
+		uint64_t getRawBytes() const;
+		uint64_t getStoredBytes() const;
+		double getEncodeSeconds() const;
+
+	private:
+		FILE* file;
+		ContourCodec codec;
+		std::vector<uint8_t> payload;
+		std::vector<uint64_t> offsets;
+		uint64_t offset;
+		uint64_t rawBytes;
+		double encodeSeconds;
+		bool error;
+};
+
+// Reads any frame of an archive through its index.
+class ArchiveReader {
+	public:
+		ArchiveReader();
+		~ArchiveReader();
+
+		bool open(const char* path);
+		int getFrames() const;
+		// Decodes frame k; false on a read error or a malformed frame.
+		bool read(int k, grid_t &grid, std::vector<vertex_t> &verts);
+		double getDecodeSeconds() const;
+
+	private:
+		FILE* file;
+		ContourCodec codec;
+		std::vector<uint8_t> payload;
+		std::vector<uint64_t> offsets;
+		double decodeSeconds;
+};
+
+#endif
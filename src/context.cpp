@@ -0,0 +1,238 @@
+#include "context.hpp"
+
+#include <GLFW/glfw3.h>
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+class WindowContext : public Context {
+	public:
+		WindowContext(GLFWwindow* window) : window(window), resized(false), newWidth(0), newHeight(0), arrowSteps(0) {}
+		~WindowContext() {
+			glfwTerminate();
+		}
+
+		const char* name() const { return "glfw"; }
+		GLADloadproc getProcLoader() const { return (GLADloadproc)glfwGetProcAddress; }
+
+		bool shouldClose() { return glfwWindowShouldClose(window); }
+		void pollEvents() { glfwPollEvents(); }
+		void swapBuffers() { glfwSwapBuffers(window); }
+		double getTime() const { return glfwGetTime(); }
+		void getFramebufferSize(int &width, int &height) const { glfwGetFramebufferSize(window, &width, &height); }
+		bool takeResize(int &width, int &height) {
+			if(!resized)
+				return false;
+			resized = false;
+			width = newWidth;
+			height = newHeight;
+			return true;
+		}
+
+		int takeArrowSteps() {
+			int steps = arrowSteps;
+			arrowSteps = 0;
+			return steps;
+		}
+
+		void onKey(int key, int action) {
+			if(key == GLFW_KEY_ESCAPE)
+				glfwSetWindowShouldClose(window, 1);
+			else if(action != GLFW_RELEASE && (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN))
+				arrowSteps += key == GLFW_KEY_UP ? 1 : -1;
+		}
+
+		// Several events in one glfwPollEvents() collapse into the last size.
+		void onResize(int width, int height) {
+			resized = true;
+			newWidth = width;
+			newHeight = height;
+		}
+
+	private:
+		GLFWwindow* window;
+		bool resized;
+		int newWidth, newHeight;
+		int arrowSteps;
+};
+
+static void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	static_cast<WindowContext*>(glfwGetWindowUserPointer(window))->onKey(key, action);
+}
+
+static void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+	static_cast<WindowContext*>(glfwGetWindowUserPointer(window))->onResize(width, height);
+}
+
+Context* createWindowContext(int width, int height, const char* title){
+	if(!glfwInit()){
+		fprintf(stderr, "ERROR: cannot start GLFW3\n");
+		return nullptr;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_SAMPLES, 4);
+
+	GLFWwindow* window = glfwCreateWindow(width, height, title, NULL, NULL);
+	if(!window) {
+		fprintf(stderr, "ERROR: could not create GLFW3 window\n");
+		glfwTerminate();
+		return nullptr;
+	}
+	glfwMakeContextCurrent(window);
+	glfwSetKeyCallback(window, keyboardCallback);
+	WindowContext* context = new WindowContext(window);
+	glfwSetWindowUserPointer(window, context);
+	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+	return context;
+}
+
+class HeadlessContext : public Context {
+	public:
+		HeadlessContext(EGLDisplay display, EGLSurface surface, EGLContext context, int width, int height)
+			: display(display), surface(surface), context(context), width(width), height(height),
+			msaaFBO(0), resolveFBO(0), msaaRBO(0), resolveRBO(0), start(std::chrono::steady_clock::now()) {}
+		~HeadlessContext() {
+			if(msaaFBO){
+				glDeleteFramebuffers(1, &msaaFBO);
+				glDeleteFramebuffers(1, &resolveFBO);
+				glDeleteRenderbuffers(1, &msaaRBO);
+				glDeleteRenderbuffers(1, &resolveRBO);
+			}
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(display, context);
+			if(surface != EGL_NO_SURFACE)
+				eglDestroySurface(display, surface);
+			eglTerminate(display);
+		}
+
+		const char* name() const { return surface == EGL_NO_SURFACE ? "egl-surfaceless" : "egl-pbuffer"; }
+		GLADloadproc getProcLoader() const { return (GLADloadproc)eglGetProcAddress; }
+
+		// Same 4x MSAA target the window asks GLFW for, resolved on swap.
+		bool initFramebuffer() {
+			glGenRenderbuffers(1, &msaaRBO);
+			glBindRenderbuffer(GL_RENDERBUFFER, msaaRBO);
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_RGBA8, width, height);
+			glGenFramebuffers(1, &msaaFBO);
+			glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaaRBO);
+
+			glGenRenderbuffers(1, &resolveRBO);
+			glBindRenderbuffer(GL_RENDERBUFFER, resolveRBO);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+			glGenFramebuffers(1, &resolveFBO);
+			glBindFramebuffer(GL_FRAMEBUFFER, resolveFBO);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveRBO);
+
+			bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+			glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+			complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+			if(!complete)
+				fprintf(stderr, "ERROR: headless framebuffer is incomplete\n");
+			return complete;
+		}
+
+		bool shouldClose() { return false; }
+		void swapBuffers() {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaFBO);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO);
+			glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, msaaFBO);
+			glFlush();
+		}
+		double getTime() const {
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		void getFramebufferSize(int &w, int &h) const { w = width; h = height; }
+
+	private:
+		EGLDisplay display;
+		EGLSurface surface;
+		EGLContext context;
+		int width, height;
+		GLuint msaaFBO, resolveFBO;
+		GLuint msaaRBO, resolveRBO;
+		std::chrono::steady_clock::time_point start;
+};
+
+static bool hasEGLExtension(const char* extensions, const char* name){
+	if(!extensions)
+		return false;
+	size_t len = strlen(name);
+	for(const char* p = strstr(extensions, name); p; p = strstr(p + len, name)){
+		if((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+			return true;
+	}
+	return false;
+}
+
+Context* createHeadlessContext(int width, int height){
+	// Prefer Mesa's surfaceless platform, it needs neither X nor a DRM device.
+	EGLDisplay display = EGL_NO_DISPLAY;
+	const char* clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if(hasEGLExtension(clientExts, "EGL_MESA_platform_surfaceless")){
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+	EGLint major, minor;
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+			fprintf(stderr, "ERROR: cannot initialize an EGL display (0x%x)\n", eglGetError());
+			return nullptr;
+		}
+	}
+	if(!eglBindAPI(EGL_OPENGL_API)){
+		fprintf(stderr, "ERROR: EGL display has no desktop OpenGL support\n");
+		eglTerminate(display);
+		return nullptr;
+	}
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 4,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	const char* displayExts = eglQueryString(display, EGL_EXTENSIONS);
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = EGL_NO_CONTEXT;
+	if(hasEGLExtension(displayExts, "EGL_KHR_surfaceless_context") && hasEGLExtension(displayExts, "EGL_KHR_no_config_context")){
+		context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttribs);
+	}
+	if(context == EGL_NO_CONTEXT){
+		// Fall back to a pbuffer; the FBO is still what gets rendered to.
+		const EGLint configAttribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+		const EGLint pbufferAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+		EGLConfig config;
+		EGLint count = 0;
+		if(eglChooseConfig(display, configAttribs, &config, 1, &count) && count > 0){
+			surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+			if(surface != EGL_NO_SURFACE)
+				context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+		}
+	}
+	if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)){
+		fprintf(stderr, "ERROR: cannot create a GL 4.4 core EGL context (0x%x)\n", eglGetError());
+		if(context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		if(surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+		return nullptr;
+	}
+	return new HeadlessContext(display, surface, context, width, height);
+}
@@ -0,0 +1,34 @@
+#ifndef __CONTEXT_HPP__
+#define __CONTEXT_HPP__
+
+#include "glad/glad.h"
+
+// Owner of the GL context and of whatever the frame is presented to.
+class Context {
+	public:
+		virtual ~Context() {}
+
+		virtual const char* name() const = 0;
+		virtual GLADloadproc getProcLoader() const = 0;
+		// Called once GL functions are loaded, before the first frame.
+		virtual bool initFramebuffer() { return true; }
+
+		virtual bool shouldClose() = 0;
+		virtual void pollEvents() {}
+		virtual void swapBuffers() = 0;
+		virtual double getTime() const = 0;
+		// In pixels, which on HiDPI displays is larger than the window size.
+		virtual void getFramebufferSize(int &width, int &height) const = 0;
+		// True once after the framebuffer was resized, with its new size.
+		virtual bool takeResize(int &width, int &height) { return false; }
+		// Up minus Down arrow presses, repeats included, since the last call.
+		virtual int takeArrowSteps() { return 0; }
+};
+
+// On-screen, resizable window; ESC closes it, Up/Down are counted for takeArrowSteps().
+Context* createWindowContext(int width, int height, const char* title);
+// No display needed: EGL surfaceless (or pbuffer) context rendering into an
+// FBO. swapBuffers() resolves the multisampled target and flushes.
+Context* createHeadlessContext(int width, int height);
+
+#endif
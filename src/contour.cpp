@@ -0,0 +1,944 @@
+#include "contour.hpp"
+#include "field.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+grid_t makeGrid(int width, int height, int res){
+	grid_t grid;
+	grid.wQuads = width / res + 1;
+	grid.hQuads = height / res + 1;
+	grid.quadHeight = 2.0f/static_cast<float>(grid.hQuads);
+	grid.quadWidth = 2.0f/static_cast<float>(grid.wQuads);
+	// As many sub-cell bits as still fit the largest coordinate in 16 bits.
+	int cells = grid.wQuads > grid.hQuads ? grid.wQuads - 1 : grid.hQuads - 1;
+	grid.quantShift = 1;
+	while(grid.quantShift < 8 && (cells << (grid.quantShift + 1)) <= 0xFFFF)
+		grid.quantShift++;
+	return grid;
+}
+
+vec2f quantScale(const grid_t &grid){
+	const float unit = 1.0f / static_cast<float>(1 << grid.quantShift);
+	return {grid.quadWidth * unit, grid.quadHeight * unit};
+}
+
+vertex_t quantize(const grid_t &grid, const vec3f &ndc){
+	const float unit = static_cast<float>(1 << grid.quantShift);
+	return {static_cast<uint16_t>(std::lround((ndc.x + 1.0f) / grid.quadWidth * unit)),
+		static_cast<uint16_t>(std::lround((ndc.y + 1.0f) / grid.quadHeight * unit))};
+}
+
+vec3f dequantize(const grid_t &grid, const vertex_t &v){
+	const vec2f scale = quantScale(grid);
+	return {v.x * scale.x - 1.0f, v.y * scale.y - 1.0f, 0.0f};
+}
+
+int getState(int a, int b, int c, int d) {
+	return d + c * 2 + b * 4 + a * 8;
+}
+
+void extractReference(const grid_t &grid, const ScalarField &field, std::vector<vec3f> &out) {
+	std::vector<int> val;
+	std::vector<float> row;
+	extractReference(grid, field, out, val, row);
+}
+
+void extractReference(const grid_t &grid, const ScalarField &field, std::vector<vec3f> &out, std::vector<int> &val, std::vector<float> &row) {
+	out.clear();
+	float wQuads = grid.wQuads;
+	float hQuads = grid.hQuads;
+	float quadHeight = grid.quadHeight;
+	float quadWidth = grid.quadWidth;
+	// Column-major, one column of hQuads samples per x.
+	growBuffer(val, static_cast<size_t>(grid.wQuads) * grid.hQuads);
+	growBuffer(row, grid.wQuads);
+	for(int i = 0; i < hQuads; i++) {
+		field.evaluate(grid, i, 0, 1, grid.wQuads, row.data());
+		for(int j = 0; j < wQuads; j++) {
+			float res = row[j];
+			val[j * hQuads + i] = res < 1 ? 0 : 1;
+		}
+	}
+	for(int i = 0; i < hQuads - 1; i++) {
+		float y = 2.0f * static_cast<float>(i) / hQuads - 1.0f;
+		for(int j = 0; j < wQuads - 1; j++) {
+			float x = 2.0f * static_cast<float>(j) / wQuads - 1.0f;
+			int a = val[j * hQuads + i];
+			int b = val[j * hQuads + i+1];
+			int c = val[(j+1) * hQuads + (i+1)];
+			int d = val[(j+1) * hQuads + i];
+			int state = getState(a, b, c, d);
+			switch(state){
+				case 0:
+				case 15:
+					break;
+				case 1:
+				case 14:
+						out.push_back({x + quadWidth / 2.0f, y, 0.0f});
+						out.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
+					break;
+				case 2:
+				case 13:
+						out.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
+						out.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
+					break;
+				case 3:
+				case 12:
+						out.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
+						out.push_back({x + quadWidth / 2.0f, y, 0.0f});
+					break;
+				case 4:
+				case 11:
+					out.push_back({x, y + quadHeight / 2.0f, 0.0f});
+					out.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
+					break;
+				case 5:
+					out.push_back({x, y + quadHeight / 2.0f, 0.0f});
+					out.push_back({x + quadWidth / 2.0f, y, 0.0f});
+					out.push_back({x+ quadWidth / 2.0f, y + quadHeight, 0.0f});
+					out.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
+					break;
+				case 6:
+				case 9:
+					out.push_back({x, y + quadHeight / 2.0f, 0.0f});
+					out.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
+					break;
+				case 7:
+				case 8:
+					out.push_back({x, y + quadHeight / 2.0f, 0.0f});
+					out.push_back({x + quadWidth / 2.0f, y, 0.0f});
+					break;
+				case 10:
+					out.push_back({x, y + quadHeight / 2.0f, 0.0f});
+					out.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
+					out.push_back({x+ quadWidth / 2.0f, y, 0.0f});
+					out.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
+					break;
+			}
+		}
+	}
+}
+
+// Same case table as extractReference, emitted in grid space for the cell
+// whose lower-left sample is (j, i).
+static inline void emitCell(int state, int j, int i, int shift, vertex_writer_t &out) {
+	const uint16_t x = j << shift;
+	const uint16_t y = i << shift;
+	const uint16_t half = 1 << (shift - 1);
+	const uint16_t full = 1 << shift;
+	switch(state){
+		case 0:
+		case 15:
+			break;
+		case 1:
+		case 14:
+			out.push_back({uint16_t(x + half), y});
+			out.push_back({uint16_t(x + full), uint16_t(y + half)});
+			break;
+		case 2:
+		case 13:
+			out.push_back({uint16_t(x + half), uint16_t(y + full)});
+			out.push_back({uint16_t(x + full), uint16_t(y + half)});
+			break;
+		case 3:
+		case 12:
+			out.push_back({uint16_t(x + half), uint16_t(y + full)});
+			out.push_back({uint16_t(x + half), y});
+			break;
+		case 4:
+		case 11:
+			out.push_back({x, uint16_t(y + half)});
+			out.push_back({uint16_t(x + half), uint16_t(y + full)});
+			break;
+		case 5:
+			out.push_back({x, uint16_t(y + half)});
+			out.push_back({uint16_t(x + half), y});
+			out.push_back({uint16_t(x + half), uint16_t(y + full)});
+			out.push_back({uint16_t(x + full), uint16_t(y + half)});
+			break;
+		case 6:
+		case 9:
+			out.push_back({x, uint16_t(y + half)});
+			out.push_back({uint16_t(x + full), uint16_t(y + half)});
+			break;
+		case 7:
+		case 8:
+			out.push_back({x, uint16_t(y + half)});
+			out.push_back({uint16_t(x + half), y});
+			break;
+		case 10:
+			out.push_back({x, uint16_t(y + half)});
+			out.push_back({uint16_t(x + half), uint16_t(y + full)});
+			out.push_back({uint16_t(x + half), y});
+			out.push_back({uint16_t(x + full), uint16_t(y + half)});
+			break;
+	}
+}
+
+void emitCellSegments(const grid_t &grid, int state, int j, int i, vertex_writer_t &out){
+	emitCell(state, j, i, grid.quantShift, out);
+}
+
+class ReferenceEngine : public ContourEngine {
+	public:
+		const char* name() const { return "reference"; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			extractReference(grid, field, verts, val, row);
+			for(const vec3f &v : verts)
+				out.push_back(quantize(grid, v));
+		}
+
+	private:
+		std::vector<vec3f> verts;
+		std::vector<int> val;
+		std::vector<float> row;
+};
+
+// Evaluates the field one row at a time and keeps only two rows of samples
+// alive. Buffers persist between calls so steady-state extraction does not allocate.
+class ScanlineEngine : public ContourEngine {
+	public:
+		const char* name() const { return "scanline"; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			const int w = grid.wQuads;
+			const int h = grid.hQuads;
+			growBuffer(values, w);
+			growBuffer(rows[0], w);
+			growBuffer(rows[1], w);
+
+			evaluateRow(grid, field, 0, rows[0].data());
+			for(int i = 0; i < h - 1; i++) {
+				const unsigned char *lo = rows[i & 1].data();
+				unsigned char *hi = rows[(i + 1) & 1].data();
+				evaluateRow(grid, field, i + 1, hi);
+				for(int j = 0; j < w - 1; j++) {
+					int state = getState(lo[j], hi[j], hi[j+1], lo[j+1]);
+					if(state != 0 && state != 15)
+						emitCell(state, j, i, grid.quantShift, out);
+				}
+			}
+		}
+
+	private:
+		void evaluateRow(const grid_t &grid, const ScalarField &field, int row, unsigned char *inside) {
+			float *acc = values.data();
+			field.evaluate(grid, row, 0, 1, grid.wQuads, acc);
+			for(int j = 0; j < grid.wQuads; j++)
+				inside[j] = acc[j] < 1 ? 0 : 1;
+		}
+
+		std::vector<float> values;
+		std::vector<unsigned char> rows[2];
+};
+
+void evaluateField(const grid_t &grid, const ScalarField &source, float *field, int rowBegin, int rowEnd){
+	const int w = grid.wQuads;
+	for(int i = rowBegin; i < rowEnd; i++)
+		source.evaluate(grid, i, 0, 1, w, field + static_cast<size_t>(i) * w);
+}
+
+void classifyCells(const grid_t &grid, const float *field, uint8_t *states, int rowBegin, int rowEnd){
+	const int w = grid.wQuads;
+	for(int i = rowBegin; i < rowEnd; i++) {
+		const float *lo = field + static_cast<size_t>(i) * w;
+		const float *hi = lo + w;
+		uint8_t *row = states + static_cast<size_t>(i) * (w - 1);
+		for(int j = 0; j < w - 1; j++)
+			row[j] = getState(lo[j] >= 1, hi[j] >= 1, hi[j+1] >= 1, lo[j+1] >= 1);
+	}
+}
+
+static uint32_t findRoot(std::vector<uint32_t> &parent, uint32_t label){
+	while(parent[label] != label){
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+// Labels the runs of hi: a run touching runs of lo joins (and merges) their
+// components, any other starts a new one.
+static void linkRuns(stats_band_t &stats){
+	const uint32_t NONE = UINT32_MAX;
+	size_t k = 0;
+	for(sample_run_t &run : stats.hi){
+		run.label = NONE;
+		while(k < stats.lo.size() && stats.lo[k].end < run.begin)
+			k++;
+		for(size_t m = k; m < stats.lo.size() && stats.lo[m].begin <= run.end; m++){
+			const uint32_t root = findRoot(stats.parent, stats.lo[m].label);
+			if(run.label == NONE){
+				run.label = root;
+			} else if(root != run.label){
+				stats.parent[root] = run.label;
+				stats.components--;
+			}
+		}
+		if(run.label == NONE){
+			run.label = static_cast<uint32_t>(stats.parent.size());
+			stats.parent.push_back(run.label);
+			stats.components++;
+		}
+	}
+	stats.lo.swap(stats.hi);
+}
+
+// Same loop as above with the statistics folded in: the case histogram, and
+// the runs of the upper sample row, found from the cases' top corners (TL is
+// 4, TR 2) as they are written.
+void classifyCells(const grid_t &grid, const float *field, uint8_t *states, int rowBegin, int rowEnd, stats_band_t &stats){
+	const int w = grid.wQuads;
+	std::fill(stats.cases, stats.cases + 16, 0);
+	stats.empty = rowBegin >= rowEnd;
+	stats.components = 0;
+	stats.parent.clear();
+	stats.lo.clear();
+	stats.hi.clear();
+	if(!stats.empty) {
+		const float *row = field + static_cast<size_t>(rowBegin) * w;
+		for(int j = 0; j < w; j++) {
+			if(row[j] < 1)
+				continue;
+			const int begin = j;
+			while(j < w && row[j] >= 1)
+				j++;
+			stats.hi.push_back({begin, j, 0});
+		}
+		linkRuns(stats);
+	}
+	stats.first = stats.lo;
+	uint32_t *cases = stats.cases;
+	for(int i = rowBegin; i < rowEnd; i++) {
+		const float *lo = field + static_cast<size_t>(i) * w;
+		const float *hi = lo + w;
+		uint8_t *row = states + static_cast<size_t>(i) * (w - 1);
+		stats.hi.clear();
+		int begin = 0;
+		for(int j = 0; j < w - 1; j++) {
+			const int state = getState(lo[j] >= 1, hi[j] >= 1, hi[j+1] >= 1, lo[j+1] >= 1);
+			row[j] = state;
+			cases[state]++;
+			if(((state >> 1) ^ (state >> 2)) & 1) {
+				if(state & 2)
+					begin = j + 1;
+				else
+					stats.hi.push_back({begin, j + 1, 0});
+			}
+		}
+		if(hi[w - 1] >= 1)
+			stats.hi.push_back({begin, w, 0});
+		linkRuns(stats);
+	}
+}
+
+// Inside area per case in eighths of a cell (a cut-off corner is one, a
+// straight cut four), and isoline length in diagonal and straight segments.
+static const uint8_t s_caseEighths[16] = { 0, 1, 1, 4, 1, 6, 4, 7, 1, 4, 6, 7, 4, 7, 7, 8 };
+static const uint8_t s_caseDiagonals[16] = { 0, 1, 1, 0, 1, 2, 0, 1, 1, 0, 2, 1, 0, 1, 1, 0 };
+static const uint8_t s_caseStraights[16] = { 0, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0 };
+
+contour_stats_t reduceStats(stats_band_t *bands, int count){
+	uint64_t cases[16] = {};
+	int components = 0;
+	for(int b = 0; b < count; b++) {
+		for(int c = 0; c < 16; c++)
+			cases[c] += bands[b].cases[c];
+		components += bands[b].components;
+	}
+
+	// Neighbouring bands share a sample row, so their runs there are the
+	// same runs; joining them merges components split by the boundary. The
+	// labels of every band go into bands[0].parent, offset past the previous.
+	std::vector<uint32_t> &parent = bands[0].parent;
+	const stats_band_t *prev = bands[0].empty ? nullptr : &bands[0];
+	uint32_t prevBase = 0;
+	for(int b = 1; b < count; b++) {
+		const stats_band_t &band = bands[b];
+		if(band.empty)
+			continue;
+		const uint32_t base = static_cast<uint32_t>(parent.size());
+		for(uint32_t label : band.parent)
+			parent.push_back(label + base);
+		if(prev) {
+			for(size_t k = 0; k < band.first.size() && k < prev->lo.size(); k++) {
+				const uint32_t a = findRoot(parent, prev->lo[k].label + prevBase);
+				const uint32_t r = findRoot(parent, band.first[k].label + base);
+				if(a != r) {
+					parent[r] = a;
+					components--;
+				}
+			}
+		}
+		prev = &band;
+		prevBase = base;
+	}
+
+	contour_stats_t stats = { 0.0, 0.0, components };
+	uint64_t eighths = 0, diagonals = 0, straights = 0;
+	for(int c = 0; c < 16; c++) {
+		eighths += cases[c] * s_caseEighths[c];
+		diagonals += cases[c] * s_caseDiagonals[c];
+		straights += cases[c] * s_caseStraights[c];
+	}
+	stats.area = eighths / 8.0;
+	stats.length = straights + diagonals * 0.70710678118654752;
+	return stats;
+}
+
+void emitCells(const grid_t &grid, const uint8_t *states, vertex_writer_t &out){
+	const int cols = grid.wQuads - 1;
+	for(int i = 0; i < grid.hQuads - 1; i++) {
+		const uint8_t *row = states + static_cast<size_t>(i) * cols;
+		for(int j = 0; j < cols; j++) {
+			if(row[j] != 0 && row[j] != 15)
+				emitCell(row[j], j, i, grid.quantShift, out);
+		}
+	}
+}
+
+// Inside of a cell per case as a convex polygon, counter-clockwise, over the
+// corners BL BR TR TL (0-3) and the edge midpoints B R T L (4-7). The saddles
+// keep their inside corners connected, as emitCell does.
+static const int8_t s_fillPolys[16][7] = {
+	{ -1 },
+	{ 4, 1, 5, -1 },
+	{ 5, 2, 6, -1 },
+	{ 4, 1, 2, 6, -1 },
+	{ 6, 3, 7, -1 },
+	{ 4, 1, 5, 6, 3, 7, -1 },
+	{ 5, 2, 3, 7, -1 },
+	{ 4, 1, 2, 3, 7, -1 },
+	{ 0, 4, 7, -1 },
+	{ 0, 1, 5, 7, -1 },
+	{ 0, 4, 5, 2, 6, 7, -1 },
+	{ 0, 1, 2, 6, 7, -1 },
+	{ 0, 4, 6, 3, -1 },
+	{ 0, 1, 5, 6, 3, -1 },
+	{ 0, 4, 5, 2, 3, -1 },
+	{ 0, 1, 2, 3, -1 }
+};
+// Position offsets within the cell, in half cells.
+static const uint8_t s_fillX[8] = { 0, 2, 2, 0, 1, 2, 1, 0 };
+static const uint8_t s_fillY[8] = { 0, 0, 2, 2, 0, 1, 2, 1 };
+
+void emitCellsFilled(const grid_t &grid, const uint8_t *states, vertex_writer_t &out, fill_mesh_t &fill){
+	const int w = grid.wQuads;
+	const int cols = w - 1;
+	const int shift = grid.quantShift;
+	const uint32_t NONE = UINT32_MAX;
+	fill.vertices.clear();
+	fill.indices.clear();
+	// Corners below and above the cell row, the midpoints of the horizontal
+	// edges below and above it and of the vertical edges within it.
+	fill.ids.assign(static_cast<size_t>(3 * w + 2 * cols), NONE);
+	uint32_t *cornerLo = fill.ids.data(), *cornerHi = cornerLo + w;
+	uint32_t *edgeLo = cornerHi + w, *edgeHi = edgeLo + cols;
+	uint32_t *const edgeV = edgeHi + cols;
+	int i = 0;
+	auto vertexId = [&](int p, int j) -> uint32_t {
+		uint32_t *slot;
+		switch(p){
+			case 0: slot = cornerLo + j; break;
+			case 1: slot = cornerLo + j + 1; break;
+			case 2: slot = cornerHi + j + 1; break;
+			case 3: slot = cornerHi + j; break;
+			case 4: slot = edgeLo + j; break;
+			case 5: slot = edgeV + j + 1; break;
+			case 6: slot = edgeHi + j; break;
+			default: slot = edgeV + j; break;
+		}
+		if(*slot == NONE){
+			*slot = static_cast<uint32_t>(fill.vertices.size());
+			fill.vertices.push_back({static_cast<uint16_t>((j << shift) + (s_fillX[p] << (shift - 1))),
+					static_cast<uint16_t>((i << shift) + (s_fillY[p] << (shift - 1)))});
+		}
+		return *slot;
+	};
+	for(; i < grid.hQuads - 1; i++) {
+		const uint8_t *row = states + static_cast<size_t>(i) * cols;
+		for(int j = 0; j < cols; j++) {
+			const int state = row[j];
+			if(state == 0)
+				continue;
+			emitCell(state, j, i, shift, out);
+			const int8_t *poly = s_fillPolys[state];
+			const uint32_t first = vertexId(poly[0], j);
+			uint32_t prev = vertexId(poly[1], j);
+			for(int k = 2; poly[k] >= 0; k++){
+				const uint32_t cur = vertexId(poly[k], j);
+				fill.indices.insert(fill.indices.end(), { first, prev, cur });
+				prev = cur;
+			}
+		}
+		std::swap(cornerLo, cornerHi);
+		std::swap(edgeLo, edgeHi);
+		std::fill(cornerHi, cornerHi + w, NONE);
+		std::fill(edgeHi, edgeHi + cols, NONE);
+		std::fill(edgeV, edgeV + w, NONE);
+	}
+}
+
+// The three stage kernels back to back; mostly here so the oracle covers them.
+class StagedEngine : public ContourEngine {
+	public:
+		const char* name() const { return "staged"; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			growBuffer(values, static_cast<size_t>(grid.wQuads) * grid.hQuads);
+			growBuffer(states, static_cast<size_t>(grid.wQuads - 1) * (grid.hQuads - 1));
+			evaluateField(grid, field, values.data(), 0, grid.hQuads);
+			classifyCells(grid, values.data(), states.data(), 0, grid.hQuads - 1, band);
+			emitCells(grid, states.data(), out);
+			stats = reduceStats(&band, 1);
+		}
+		bool getStats(contour_stats_t &stats) const {
+			stats = this->stats;
+			return true;
+		}
+
+	private:
+		std::vector<float> values;
+		std::vector<uint8_t> states;
+		stats_band_t band;
+		contour_stats_t stats;
+};
+
+// False if the field is provably on one side of the threshold over lattice
+// box [x0, x1] x [y0, y1].
+static bool mayCross(const ScalarField &field, const grid_t &grid, int x0, int y0, int x1, int y1) {
+	return boundedSide(field, grid, x0, y0, x1, y1) < 0;
+}
+
+// Refines a quadtree over the cells only where the contour can be. A block
+// mayCross() rules out has every sample, borders included, on the same side
+// and so no contour. Other blocks are split down to LEAF cells a side and sampled at
+// the full resolution, so the output is exactly that of the uniform grid and
+// neighbouring leaves agree on their shared samples.
+class QuadtreeEngine : public ContourEngine {
+	public:
+		const char* name() const { return "quadtree"; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			refine(grid, field, 0, 0, grid.wQuads - 1, grid.hQuads - 1, out);
+		}
+
+	private:
+		static const int LEAF = 8;
+
+		// Cells [x0, x1) x [y0, y1), samples [x0, x1] x [y0, y1].
+		void refine(const grid_t &grid, const ScalarField &field, int x0, int y0, int x1, int y1, vertex_writer_t &out) {
+			if(x0 >= x1 || y0 >= y1)
+				return;
+			if(!mayCross(field, grid, x0, y0, x1, y1))
+				return;
+
+			if(x1 - x0 <= LEAF && y1 - y0 <= LEAF) {
+				leaf(grid, field, x0, y0, x1, y1, out);
+				return;
+			}
+			const int xm = x1 - x0 > LEAF ? (x0 + x1) / 2 : x1;
+			const int ym = y1 - y0 > LEAF ? (y0 + y1) / 2 : y1;
+			refine(grid, field, x0, y0, xm, ym, out);
+			refine(grid, field, xm, y0, x1, ym, out);
+			refine(grid, field, x0, ym, xm, y1, out);
+			refine(grid, field, xm, ym, x1, y1, out);
+		}
+
+		void leaf(const grid_t &grid, const ScalarField &field, int x0, int y0, int x1, int y1, vertex_writer_t &out) {
+			const int w = x1 - x0 + 1;
+			float acc[LEAF + 1];
+			for(int i = y0; i <= y1; i++) {
+				field.evaluate(grid, i, x0, 1, w, acc);
+				unsigned char *row = inside[(i - y0) & 1];
+				for(int j = 0; j < w; j++)
+					row[j] = acc[j] < 1 ? 0 : 1;
+				if(i == y0)
+					continue;
+				const unsigned char *lo = inside[(i - 1 - y0) & 1];
+				for(int j = 0; j < w - 1; j++) {
+					int state = getState(lo[j], row[j], row[j+1], lo[j+1]);
+					if(state != 0 && state != 15)
+						emitCell(state, x0 + j, i - 1, grid.quantShift, out);
+				}
+			}
+		}
+
+		unsigned char inside[2][LEAF + 1];
+};
+
+// Follows the contour instead of scanning for it. The border and the cell
+// row and column through each of the field's interior points (the sphere
+// centres) are seeded first and flooded across the cell edges the contour
+// crosses, which finds the open isolines and most closed ones. Then the
+// blocks mayCross() cannot rule out are swept down to SWEEP_LEAF cells, so
+// holes in merged blobs and slivers narrower than a cell that no seed line
+// crosses are found as well. Samples are evaluated lazily and cached, so the
+// sweep mostly reuses what the floods sampled, and the work is proportional
+// to the contour length (the blocks along it) rather than the grid area.
+class TraceEngine : public ContourEngine {
+	public:
+		const char* name() const { return "trace"; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			begin(grid);
+			seedLines(field);
+			traceSeeds(field, grid.quantShift, out);
+			sweep(field, 0, 0, w - 1, h - 1);
+			traceSeeds(field, grid.quantShift, out);
+		}
+
+	protected:
+		static const int LEAF = 8;
+		static const int SWEEP_LEAF = 2;
+
+		void begin(const grid_t &grid) {
+			lattice = grid;
+			w = grid.wQuads;
+			h = grid.hQuads;
+			wf = static_cast<float>(w);
+			hf = static_cast<float>(h);
+			tilesW = (w + TILE - 1) / TILE;
+			tileIndex.clear();
+			tilesUsed = 0;
+			lastKey = -1;
+			seeds.clear();
+			traced = 0;
+			emitted.clear();
+			loops.clear();
+		}
+
+		void seedLines(const ScalarField &field) {
+			seededRows.clear();
+			seededCols.clear();
+			points.clear();
+			if(!field.interiorPoints(points)) {
+				seed(field, 0, 0, w - 1, h - 1);
+				return;
+			}
+			// Open isolines end on the border, closed ones enclose an interior point.
+			seededRows.insert(0);
+			seededRows.insert(h - 2);
+			seededCols.insert(0);
+			seededCols.insert(w - 2);
+			seed(field, 0, 0, w - 1, 1);
+			seed(field, 0, h - 2, w - 1, h - 1);
+			seed(field, 0, 0, 1, h - 1);
+			seed(field, w - 2, 0, w - 1, h - 1);
+			for(const vec2f &p : points) {
+				const int j = std::min(std::max(static_cast<int>((p.x + 1.0f) * 0.5f * wf), 0), w - 2);
+				const int i = std::min(std::max(static_cast<int>((p.y + 1.0f) * 0.5f * hf), 0), h - 2);
+				if(seededRows.insert(i).second)
+					seed(field, 0, i, w - 1, i + 1);
+				if(seededCols.insert(j).second)
+					seed(field, j, 0, j + 1, h - 1);
+			}
+		}
+
+		// Floods every seed not flooded yet; the emitted cells are left in emitted.
+		void traceSeeds(const ScalarField &field, int shift, vertex_writer_t &out) {
+			for(; traced < seeds.size(); traced++)
+				trace(field, seeds[traced], shift, out);
+		}
+
+		// Pushes the crossing cells of [x0, x1) x [y0, y1) not pushed before.
+		void seed(const ScalarField &field, int x0, int y0, int x1, int y1) {
+			if(x0 >= x1 || y0 >= y1)
+				return;
+			if(!mayCross(field, lattice, x0, y0, x1, y1))
+				return;
+			if(x1 - x0 <= LEAF && y1 - y0 <= LEAF) {
+				// Cells already seeded, or visited by a flood, need no samples.
+				bool pending = false;
+				for(int i = y0; i < y1 && !pending; i++)
+					for(int j = x0; j < x1 && !pending; j++)
+						pending = !(tile(j, i).flags[(i % TILE) * TILE + j % TILE] & (SEEDED | VISITED));
+				if(!pending)
+					return;
+				// Whole block rows at once, as quadtree samples its leaves; going
+				// through the sample cache would cost a lookup per sample.
+				const int n = x1 - x0 + 1;
+				float acc[LEAF + 1];
+				for(int i = y0; i <= y1; i++) {
+					field.evaluate(lattice, i, x0, 1, n, acc);
+					unsigned char *row = blockRows[(i - y0) & 1];
+					for(int k = 0; k < n; k++)
+						row[k] = acc[k] < 1 ? 0 : 1;
+					if(i == y0)
+						continue;
+					const unsigned char *lo = blockRows[(i - 1 - y0) & 1];
+					for(int j = x0; j < x1; j++) {
+						uint8_t &flags = tile(j, i - 1).flags[((i - 1) % TILE) * TILE + j % TILE];
+						if(flags & (SEEDED | VISITED))
+							continue;
+						flags |= SEEDED;
+						const int k = j - x0;
+						const int state = getState(lo[k], row[k], row[k + 1], lo[k + 1]);
+						if(state != 0 && state != 15)
+							seeds.push_back(static_cast<int64_t>(i - 1) * w + j);
+					}
+				}
+				return;
+			}
+			if(x1 - x0 >= y1 - y0) {
+				seed(field, x0, y0, (x0 + x1) / 2, y1);
+				seed(field, (x0 + x1) / 2, y0, x1, y1);
+			} else {
+				seed(field, x0, y0, x1, (y0 + y1) / 2);
+				seed(field, x0, (y0 + y1) / 2, x1, y1);
+			}
+		}
+
+		// seed() for what the floods left: blocks down to SWEEP_LEAF cells a
+		// side, whose samples the floods mostly cached already next to the
+		// contour they followed.
+		void sweep(const ScalarField &field, int x0, int y0, int x1, int y1) {
+			if(x0 >= x1 || y0 >= y1)
+				return;
+			if(x1 - x0 <= SWEEP_LEAF && y1 - y0 <= SWEEP_LEAF) {
+				for(int i = y0; i < y1; i++) {
+					for(int j = x0; j < x1; j++) {
+						uint8_t &flags = tile(j, i).flags[(i % TILE) * TILE + j % TILE];
+						if(flags & (SEEDED | VISITED))
+							continue;
+						flags |= SEEDED;
+						const int state = cellState(field, j, i);
+						if(state != 0 && state != 15)
+							seeds.push_back(static_cast<int64_t>(i) * w + j);
+					}
+				}
+				return;
+			}
+			if(!mayCross(field, lattice, x0, y0, x1, y1))
+				return;
+			if(x1 - x0 >= y1 - y0) {
+				sweep(field, x0, y0, (x0 + x1) / 2, y1);
+				sweep(field, (x0 + x1) / 2, y0, x1, y1);
+			} else {
+				sweep(field, x0, y0, x1, (y0 + y1) / 2);
+				sweep(field, x0, (y0 + y1) / 2, x1, y1);
+			}
+		}
+
+		// Floods the isoline through start; if it is new, its cells are
+		// appended to emitted as one entry of loops.
+		void trace(const ScalarField &field, int64_t start, int shift, vertex_writer_t &out) {
+			const size_t first = emitted.size();
+			stack.clear();
+			stack.push_back(start);
+			while(!stack.empty()) {
+				const int64_t cell = stack.back();
+				stack.pop_back();
+				const int j = static_cast<int>(cell % w);
+				const int i = static_cast<int>(cell / w);
+				tile_t &t = tile(j, i);
+				uint8_t &flags = t.flags[(i % TILE) * TILE + j % TILE];
+				if(flags & VISITED)
+					continue;
+				flags |= VISITED;
+				const int a = sample(field, j, i);
+				const int b = sample(field, j, i + 1);
+				const int c = sample(field, j + 1, i + 1);
+				const int d = sample(field, j + 1, i);
+				const int state = getState(a, b, c, d);
+				if(state == 0 || state == 15)
+					continue;
+				emitCell(state, j, i, shift, out);
+				emitted.push_back(cell);
+				// The neighbour across a crossed edge shares its two corners, so it is crossed too.
+				if(a != b && j > 0) stack.push_back(cell - 1);
+				if(c != d && j < w - 2) stack.push_back(cell + 1);
+				if(a != d && i > 0) stack.push_back(cell - w);
+				if(b != c && i < h - 2) stack.push_back(cell + w);
+			}
+			if(emitted.size() > first)
+				loops.push_back(first);
+		}
+
+		int cellState(const ScalarField &field, int j, int i) {
+			return getState(sample(field, j, i), sample(field, j, i + 1), sample(field, j + 1, i + 1), sample(field, j + 1, i));
+		}
+
+		// A miss evaluates the aligned run of BATCH samples around it; the
+		// walk usually needs the neighbours, and single-sample calls would
+		// pay the field's dispatch per sample.
+		int sample(const ScalarField &field, int j, int i) {
+			uint8_t *row = tile(j, i).sample + (i % TILE) * TILE;
+			if(row[j % TILE] != UNKNOWN)
+				return row[j % TILE];
+			const int j0 = j - j % BATCH;
+			const int n = w - j0 < BATCH ? w - j0 : BATCH;
+			float res[BATCH];
+			field.evaluate(lattice, i, j0, 1, n, res);
+			for(int k = 0; k < n; k++)
+				row[j0 % TILE + k] = res[k] < 1 ? 0 : 1;
+			return row[j % TILE];
+		}
+
+		// Sample and visited state is kept in TILE x TILE tiles allocated on
+		// first touch, so the grid size never costs memory; tiles are recycled
+		// across frames.
+		static const int TILE = 32;
+		static const int BATCH = 4;
+		static const uint8_t UNKNOWN = 0xFF;
+		static const uint8_t VISITED = 1;
+		static const uint8_t SEEDED = 2;
+		struct tile_t {
+			uint8_t sample[TILE * TILE];
+			uint8_t flags[TILE * TILE];
+		};
+
+		tile_t& tile(int j, int i) {
+			const int64_t key = static_cast<int64_t>(i / TILE) * tilesW + j / TILE;
+			if(key == lastKey)
+				return tiles[lastTile];
+			auto it = tileIndex.find(key);
+			if(it == tileIndex.end()) {
+				if(tilesUsed == tiles.size())
+					tiles.emplace_back();
+				tile_t &t = tiles[tilesUsed];
+				std::memset(t.sample, UNKNOWN, sizeof(t.sample));
+				std::memset(t.flags, 0, sizeof(t.flags));
+				it = tileIndex.emplace(key, tilesUsed++).first;
+			}
+			lastKey = key;
+			lastTile = it->second;
+			return tiles[lastTile];
+		}
+
+		grid_t lattice;
+		int w, h;
+		float wf, hf;
+		std::vector<vec2f> points;
+		int64_t tilesW;
+		std::deque<tile_t> tiles;
+		size_t tilesUsed;
+		std::unordered_map<int64_t, size_t> tileIndex;
+		int64_t lastKey;
+		size_t lastTile;
+		std::unordered_set<int> seededRows, seededCols;
+		std::vector<int64_t> seeds;
+		size_t traced;
+		unsigned char blockRows[2][LEAF + 1];
+		std::vector<int64_t> stack;
+		std::vector<int64_t> emitted;
+		// Start of each flood's cells in emitted.
+		std::vector<size_t> loops;
+};
+
+// Trace seeded from the previous frame: instead of the seed lines, a few
+// cells of each of last frame's loops are searched for the isoline, as far
+// as the field says anything moved (the spheres) plus one cell, and flooded.
+// The sweep then only has the cells those floods did not reach left, and
+// finds whatever the searches could not: a hole that opened or a loop that
+// split or appeared. Whenever the grid changes, the field cannot bound its
+// motion or the search would get too wide, the whole grid is seeded exactly
+// as quadtree does.
+class TemporalEngine : public TraceEngine {
+	public:
+		TemporalEngine() : coherent(0), prevW(0), prevH(0) {}
+
+		const char* name() const { return "temporal"; }
+		unsigned long getCoherentFrames() const { return coherent; }
+		void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) {
+			begin(grid);
+			int radius = BAND_LIMIT + 1;
+			float moved;
+			if(field.trackMotion(history, &moved) && grid.wQuads == prevW && grid.hQuads == prevH)
+				radius = static_cast<int>(std::ceil(moved / std::min(grid.quadWidth, grid.quadHeight))) + 1;
+
+			if(radius > BAND_LIMIT) {
+				seed(field, 0, 0, w - 1, h - 1);
+				traceSeeds(field, grid.quantShift, out);
+			} else {
+				coherent++;
+				for(size_t l = 0; l < activeLoops.size(); l++) {
+					const size_t first = activeLoops[l];
+					const size_t count = (l + 1 < activeLoops.size() ? activeLoops[l + 1] : active.size()) - first;
+					const size_t stride = count > PROBES ? count / PROBES : 1;
+					for(size_t k = 0; k < count; k += stride)
+						search(field, active[first + k], radius, grid.quantShift, out);
+				}
+				// Whatever the searches missed, a new loop or one that split, the
+				// sweep finds; it skips the cells the floods above went through.
+				sweep(field, 0, 0, w - 1, h - 1);
+				traceSeeds(field, grid.quantShift, out);
+			}
+
+			active.swap(emitted);
+			activeLoops.swap(loops);
+			prevW = grid.wQuads;
+			prevH = grid.hQuads;
+		}
+
+	private:
+		// Looks for the isoline that passed through an old cell in rings of
+		// growing distance. A visited cell means a flood already went by; a
+		// new crossing cell is flooded at once.
+		void search(const ScalarField &field, int64_t cell, int radius, int shift, vertex_writer_t &out) {
+			const int cj = static_cast<int>(cell % w);
+			const int ci = static_cast<int>(cell / w);
+			for(int d = 0; d <= radius; d++) {
+				const int i0 = std::max(ci - d, 0), i1 = std::min(ci + d, h - 2);
+				const int j0 = std::max(cj - d, 0), j1 = std::min(cj + d, w - 2);
+				for(int i = i0; i <= i1; i++) {
+					// Inner rows only have their two ends on the ring.
+					const int step = (i == ci - d || i == ci + d) ? 1 : 2 * d;
+					for(int j = cj - d; j <= cj + d; j += step) {
+						if(j < j0 || j > j1)
+							continue;
+						if(tile(j, i).flags[(i % TILE) * TILE + j % TILE] & VISITED)
+							return;
+						int state = cellState(field, j, i);
+						if(state != 0 && state != 15) {
+							trace(field, static_cast<int64_t>(i) * w + j, shift, out);
+							return;
+						}
+					}
+				}
+			}
+		}
+
+		// Old cells searched per loop; more than one so a loop that split is
+		// likely to be found in each piece.
+		static const size_t PROBES = 8;
+		// Searching a band this wide around a vanished loop costs about as much
+		// as seeding the whole grid.
+		static const int BAND_LIMIT = 32;
+
+		unsigned long coherent;
+		int prevW, prevH;
+		std::vector<float> history;
+		std::vector<int64_t> active;
+		std::vector<size_t> activeLoops;
+};
+
+void extractToVector(ContourEngine* engine, const grid_t &grid, const ScalarField &field, std::vector<vertex_t> &out){
+	out.resize(out.capacity() > 1024 ? out.capacity() : 1024);
+	for(;;) {
+		vertex_writer_t writer = makeWriter(out.data(), out.size());
+		engine->extract(grid, field, writer);
+		if(!writer.overflowed()) {
+			out.resize(writer.count);
+			return;
+		}
+		growBuffer(out, writer.count);
+	}
+}
+
+static const char* const s_engineNames[] = { "reference", "scanline", "staged", "quadtree", "trace", "temporal", nullptr };
+
+ContourEngine* createEngine(const char* name){
+	if(strcmp(name, "reference") == 0) return new ReferenceEngine();
+	if(strcmp(name, "scanline") == 0) return new ScanlineEngine();
+	if(strcmp(name, "staged") == 0) return new StagedEngine();
+	if(strcmp(name, "quadtree") == 0) return new QuadtreeEngine();
+	if(strcmp(name, "trace") == 0) return new TraceEngine();
+	if(strcmp(name, "temporal") == 0) return new TemporalEngine();
+	return nullptr;
+}
+
+const char* const* engineNames(){
+	return s_engineNames;
+}
@@ -0,0 +1,181 @@
+#ifndef __CONTOUR_HPP__
+#define __CONTOUR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct vec3f{
+	float x;
+	float y;
+	float z;
+};
+struct vec2f{
+	float x;
+	float y;
+};
+struct sphere_t {
+	vec2f pos;
+	vec2f vel;
+	float rad;
+	float dist(float x, float y) const {
+		return ((rad*rad)/((x - pos.x)*(x - pos.x) + (y - pos.y)*(y - pos.y)));
+	};
+};
+
+// Sample lattice covering NDC [-1, 1]: wQuads x hQuads samples, one every
+// quadWidth x quadHeight. Emitted vertices are in grid space, fixed point with
+// quantShift fractional bits per cell, so they fit a uint16 pair.
+struct grid_t {
+	int wQuads;
+	int hQuads;
+	float quadWidth;
+	float quadHeight;
+	int quantShift;
+};
+
+// Isoline VBO vertex. NDC = (x, y) * quantScale(grid) - 1, done in vert.glsl.
+struct vertex_t {
+	uint16_t x;
+	uint16_t y;
+};
+
+// Largest per-axis cell count a vertex_t can address at one fractional bit.
+const int MAX_GRID_CELLS = 32767;
+
+// Bounded destination for emitted vertices, e.g. a mapped GL buffer. Vertices
+// past end are counted but dropped, so the caller can grow and extract again.
+struct vertex_writer_t {
+	vertex_t *begin;
+	vertex_t *cur;
+	vertex_t *end;
+	size_t count;
+	void push_back(const vertex_t &v) {
+		if(cur != end) *cur++ = v;
+		count++;
+	}
+	bool overflowed() const { return count > static_cast<size_t>(end - begin); }
+};
+
+inline vertex_writer_t makeWriter(vertex_t *dst, size_t capacity){
+	return {dst, dst, dst + capacity, 0};
+}
+
+// Resizes v to n, but when that needs more room grows the capacity by at
+// least half, so a window being resized does not reallocate on every frame.
+// Shrinking keeps the allocation.
+template <typename T>
+inline void growBuffer(std::vector<T> &v, size_t n){
+	if(n > v.capacity())
+		v.reserve(n > v.capacity() + v.capacity() / 2 ? n : v.capacity() + v.capacity() / 2);
+	v.resize(n);
+}
+
+grid_t makeGrid(int width, int height, int res);
+int getState(int a, int b, int c, int d);
+
+// NDC coordinate of lattice sample k out of n along one axis.
+inline float sampleCoord(int k, float n) {
+	return 2.0f * static_cast<float>(k) / n - 1.0f;
+}
+
+// Grid-space to NDC scale for each axis, fed to the vertex shader.
+vec2f quantScale(const grid_t &grid);
+vertex_t quantize(const grid_t &grid, const vec3f &ndc);
+vec3f dequantize(const grid_t &grid, const vertex_t &v);
+
+class ScalarField;
+
+// The original scalar setupGrid() path, NDC output. Every other engine is checked against it.
+void extractReference(const grid_t &grid, const ScalarField &field, std::vector<vec3f> &out);
+// The same with the caller's sample buffers, grown as needed, so calling it
+// every frame does not allocate.
+void extractReference(const grid_t &grid, const ScalarField &field, std::vector<vec3f> &out, std::vector<int> &val, std::vector<float> &row);
+
+// Whole-grid stages of the scanline engine, for callers that schedule them
+// separately. field is wQuads x hQuads row-major, states one case index per
+// cell, (wQuads - 1) x (hQuads - 1) row-major; row ranges allow splitting a
+// stage into bands.
+void evaluateField(const grid_t &grid, const ScalarField &source, float *field, int rowBegin, int rowEnd);
+void classifyCells(const grid_t &grid, const float *field, uint8_t *states, int rowBegin, int rowEnd);
+void emitCells(const grid_t &grid, const uint8_t *states, vertex_writer_t &out);
+
+// Size of the contour in cells: the inside area, each cell counting its
+// inside part, the isoline length, and the number of inside components. The
+// lattice border is not part of the length and does not close components.
+struct contour_stats_t {
+	double area;
+	double length;
+	int components;
+};
+
+// A run [begin, end) of inside samples along a row and its component.
+struct sample_run_t {
+	int begin;
+	int end;
+	uint32_t label;
+};
+
+// What classifyCells gathers towards contour_stats_t over one row band, so
+// each thread writes only its own. Components are runs of inside samples
+// joined to the runs they touch in the next row, diagonals included, as the
+// saddle cases keep their inside corners connected.
+struct stats_band_t {
+	uint32_t cases[16];
+	bool empty;
+	int components;
+	// Union-find over the band's component labels.
+	std::vector<uint32_t> parent;
+	// Runs of the band's first sample row, and of the row last classified.
+	std::vector<sample_run_t> first, lo;
+	std::vector<sample_run_t> hi;
+};
+
+// classifyCells that also accumulates stats for its band.
+void classifyCells(const grid_t &grid, const float *field, uint8_t *states, int rowBegin, int rowEnd, stats_band_t &stats);
+// Totals of bands classified as consecutive row bands of one grid, in order.
+// Merges the components that meet across band boundaries into bands[0].
+contour_stats_t reduceStats(stats_band_t *bands, int count);
+
+// Inside of the isoline (value >= 1) as an indexed, counter-clockwise triangle
+// list in the same fixed point as the lines. Cell corners and edge midpoints
+// are shared by every cell that touches them, cells entirely inside
+// included, so neighbouring triangles always meet edge to edge.
+struct fill_mesh_t {
+	std::vector<vertex_t> vertices;
+	std::vector<uint32_t> indices;
+	// Vertex ids of the positions along the cell row being filled.
+	std::vector<uint32_t> ids;
+};
+
+// emitCells that also fills: the same walk over the states writes the lines
+// to out and the inside to fill, which is replaced.
+void emitCellsFilled(const grid_t &grid, const uint8_t *states, vertex_writer_t &out, fill_mesh_t &fill);
+
+// GL_LINES segments of the cell whose lower-left sample is (j, i) for case
+// state (getState), for callers that classify cells themselves.
+void emitCellSegments(const grid_t &grid, int state, int j, int i, vertex_writer_t &out);
+
+class ContourEngine {
+	public:
+		virtual ~ContourEngine() {}
+
+		virtual const char* name() const = 0;
+		// Writes GL_LINES vertex pairs into out.
+		virtual void extract(const grid_t &grid, const ScalarField &field, vertex_writer_t &out) = 0;
+		// Statistics of the last extract(), gathered while extracting; false
+		// if the engine does not gather them.
+		virtual bool getStats(contour_stats_t &) const { return false; }
+		// Extractions so far that started from the previous frame's contour
+		// instead of searching the whole grid; 0 for engines without memory.
+		virtual unsigned long getCoherentFrames() const { return 0; }
+};
+
+// Replaces the contents of out with the engine's output, growing it as needed.
+void extractToVector(ContourEngine* engine, const grid_t &grid, const ScalarField &field, std::vector<vertex_t> &out);
+
+// Returns nullptr for an unknown name; the caller owns the engine.
+ContourEngine* createEngine(const char* name);
+const char* const* engineNames();
+
+#endif
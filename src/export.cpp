@@ -0,0 +1,296 @@
+#include "export.hpp"
+#include "raster.hpp"
+
+#include <chrono>
+#include <cstring>
+
+BufferedWriter::BufferedWriter(FILE* out) : out(out), buffer(CAPACITY), used(0), error(false) {}
+
+char* BufferedWriter::reserve(size_t bytes){
+	if(used + bytes > CAPACITY)
+		flush();
+	return buffer.data() + used;
+}
+
+void BufferedWriter::commit(char* end){
+	used = end - buffer.data();
+}
+
+void BufferedWriter::write(const void* data, size_t bytes){
+	const char* p = static_cast<const char*>(data);
+	while(bytes > 0){
+		char* dst = reserve(bytes < CAPACITY ? bytes : CAPACITY);
+		const size_t n = bytes < CAPACITY - used ? bytes : CAPACITY - used;
+		memcpy(dst, p, n);
+		commit(dst + n);
+		p += n;
+		bytes -= n;
+	}
+}
+
+void BufferedWriter::print(const char* text){
+	write(text, strlen(text));
+}
+
+bool BufferedWriter::flush(){
+	if(used > 0 && !error && fwrite(buffer.data(), 1, used, out) != used)
+		error = true;
+	used = 0;
+	return !error;
+}
+
+bool BufferedWriter::failed() const {
+	return error;
+}
+
+// Longest text formatCoord() writes: sign, 9 integer digits, point, 4 decimals.
+static const size_t COORD_CHARS = 16;
+
+static const char s_digitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+// v rounded to 1e-4 with trailing zeros dropped, "12.5" or "3"; well below
+// the spacing of any lattice. Digits are written two at a time from a table,
+// several times faster than printf, which the text formats would otherwise
+// spend most of their time in. Magnitudes beyond 1e9 are clamped.
+static char* formatCoord(char* p, float v){
+	if(v < 0.0f){
+		*p++ = '-';
+		v = -v;
+	}
+	const uint64_t fixed = v < 1e9f ? static_cast<uint64_t>(static_cast<double>(v) * 10000.0 + 0.5) : UINT64_C(9999999999999);
+	uint32_t whole = static_cast<uint32_t>(fixed / 10000);
+	uint32_t frac = static_cast<uint32_t>(fixed % 10000);
+
+	int digits = 1;
+	for(uint32_t k = whole; k >= 10; k /= 10)
+		digits++;
+	char *end = p + digits;
+	char *q = end;
+	while(whole >= 100){
+		q -= 2;
+		memcpy(q, s_digitPairs + (whole % 100) * 2, 2);
+		whole /= 100;
+	}
+	if(whole >= 10){
+		q -= 2;
+		memcpy(q, s_digitPairs + whole * 2, 2);
+	} else {
+		*--q = '0' + whole;
+	}
+	if(frac == 0)
+		return end;
+	*end = '.';
+	memcpy(end + 1, s_digitPairs + (frac / 100) * 2, 2);
+	memcpy(end + 3, s_digitPairs + (frac % 100) * 2, 2);
+	end += 5;
+	while(end[-1] == '0')
+		end--;
+	return end;
+}
+
+BinarySegmentSink::BinarySegmentSink(FILE* out, int width, int height) : out(out), writer(out), count(0) {
+	uint8_t header[SEGMENT_HEADER_BYTES] = { 'M', 'S', 'Q', 'S' };
+	writeLE32(header + 4, 1);
+	writeLE32(header + 8, width);
+	writeLE32(header + 12, height);
+	writeLE64(header + 16, UINT64_MAX);
+	writer.write(header, sizeof(header));
+}
+
+bool BinarySegmentSink::write(const segment_t *segments, size_t count){
+	const size_t RECORD = 4 * sizeof(float);
+	for(size_t k = 0; k < count; k++){
+		uint8_t *p = reinterpret_cast<uint8_t*>(writer.reserve(RECORD));
+		writeLE32f(p, segments[k].x0);
+		writeLE32f(p + 4, segments[k].y0);
+		writeLE32f(p + 8, segments[k].x1);
+		writeLE32f(p + 12, segments[k].y1);
+		writer.commit(reinterpret_cast<char*>(p + RECORD));
+	}
+	this->count += count;
+	return !writer.failed();
+}
+
+// Patches the count into the header when the output can seek back to it.
+bool BinarySegmentSink::finish(){
+	if(!writer.flush())
+		return false;
+	uint8_t total[8];
+	writeLE64(total, count);
+	if(fseek(out, 16, SEEK_SET) == 0){
+		if(fwrite(total, 1, sizeof(total), out) != sizeof(total))
+			return false;
+		fseek(out, 0, SEEK_END);
+	}
+	return true;
+}
+
+SvgSegmentSink::SvgSegmentSink(FILE* out, int width, int height) : writer(out), height(height) {
+	char header[256];
+	snprintf(header, sizeof(header),
+			"<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n"
+			"<g fill=\"none\" stroke=\"black\" stroke-width=\"1\">\n",
+			width - 1, height - 1, width - 1, height - 1);
+	writer.print(header);
+}
+
+bool SvgSegmentSink::write(const segment_t *segments, size_t count){
+	if(count == 0)
+		return true;
+	const float top = static_cast<float>(height - 1);
+	writer.print("<path d=\"");
+	for(size_t k = 0; k < count; k++){
+		char *p = writer.reserve(4 * COORD_CHARS + 8);
+		*p++ = 'M';
+		p = formatCoord(p, segments[k].x0);
+		*p++ = ' ';
+		p = formatCoord(p, top - segments[k].y0);
+		*p++ = ' ';
+		p = formatCoord(p, segments[k].x1);
+		*p++ = ' ';
+		p = formatCoord(p, top - segments[k].y1);
+		writer.commit(p);
+	}
+	writer.print("\"/>\n");
+	return !writer.failed();
+}
+
+bool SvgSegmentSink::finish(){
+	writer.print("</g>\n</svg>\n");
+	return writer.flush();
+}
+
+GeoJsonSegmentSink::GeoJsonSegmentSink(FILE* out, float isovalue) : writer(out), first(true) {
+	char header[256];
+	snprintf(header, sizeof(header),
+			"{\"type\":\"FeatureCollection\",\"features\":[{\"type\":\"Feature\",\"properties\":{\"isovalue\":%.9g},"
+			"\"geometry\":{\"type\":\"MultiLineString\",\"coordinates\":[\n", isovalue);
+	writer.print(header);
+}
+
+bool GeoJsonSegmentSink::write(const segment_t *segments, size_t count){
+	for(size_t k = 0; k < count; k++){
+		char *p = writer.reserve(4 * COORD_CHARS + 16);
+		if(!first)
+			*p++ = ',';
+		first = false;
+		*p++ = '[';
+		*p++ = '[';
+		p = formatCoord(p, segments[k].x0);
+		*p++ = ',';
+		p = formatCoord(p, segments[k].y0);
+		*p++ = ']';
+		*p++ = ',';
+		*p++ = '[';
+		p = formatCoord(p, segments[k].x1);
+		*p++ = ',';
+		p = formatCoord(p, segments[k].y1);
+		*p++ = ']';
+		*p++ = ']';
+		// A line per segment keeps the file friendly to line-based tools.
+		*p++ = '\n';
+		writer.commit(p);
+	}
+	return !writer.failed();
+}
+
+bool GeoJsonSegmentSink::finish(){
+	writer.print("]}}]}\n");
+	return writer.flush();
+}
+
+AsyncSegmentSink::AsyncSegmentSink(SegmentSink &sink, size_t batchCapacity)
+	: sink(sink), buffers(BUFFERS, std::vector<segment_t>(batchCapacity)), counts(BUFFERS, 0),
+	head(0), queued(0), stopping(false), error(false), stalled(0.0) {
+	thread = std::thread(&AsyncSegmentSink::run, this);
+}
+
+AsyncSegmentSink::~AsyncSegmentSink(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	cond.notify_all();
+	if(thread.joinable())
+		thread.join();
+}
+
+bool AsyncSegmentSink::write(const segment_t *segments, size_t count){
+	const size_t capacity = buffers[0].size();
+	while(count > 0){
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if(queued == BUFFERS){
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				cond.wait(lock, [this]{ return queued < BUFFERS || error; });
+				stalled += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			if(error)
+				return false;
+			slot = (head + queued) % BUFFERS;
+		}
+		// Not queued yet, so the writer thread does not touch it.
+		const size_t n = count < capacity ? count : capacity;
+		memcpy(buffers[slot].data(), segments, n * sizeof(segment_t));
+		counts[slot] = n;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queued++;
+		}
+		cond.notify_all();
+		segments += n;
+		count -= n;
+	}
+	return true;
+}
+
+bool AsyncSegmentSink::finish(){
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this]{ return queued == 0 || error; });
+		stopping = true;
+	}
+	cond.notify_all();
+	thread.join();
+	return !error && sink.finish();
+}
+
+double AsyncSegmentSink::getStallSeconds() const {
+	return stalled;
+}
+
+void AsyncSegmentSink::run(){
+	for(;;){
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this]{ return queued > 0 || stopping; });
+			if(queued == 0)
+				return;
+			slot = head;
+		}
+		const bool ok = sink.write(buffers[slot].data(), counts[slot]);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			head = (head + 1) % BUFFERS;
+			queued--;
+			if(!ok)
+				error = true;
+		}
+		cond.notify_all();
+		if(!ok)
+			return;
+	}
+}
+
+SegmentSink* createSegmentSink(const char* format, FILE* out, int width, int height, float isovalue){
+	if(strcmp(format, "raw") == 0) return new RawSegmentSink(out);
+	if(strcmp(format, "bin") == 0) return new BinarySegmentSink(out, width, height);
+	if(strcmp(format, "svg") == 0) return new SvgSegmentSink(out, width, height);
+	if(strcmp(format, "geojson") == 0) return new GeoJsonSegmentSink(out, isovalue);
+	return nullptr;
+}
@@ -0,0 +1,131 @@
+#ifndef __EXPORT_HPP__
+#define __EXPORT_HPP__
+
+#include "stream.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One fixed output buffer in front of a FILE*, handed to fwrite whole when
+// full. Text is formatted straight into it, so writing a record allocates
+// nothing and costs no stdio call.
+class BufferedWriter {
+	public:
+		static const size_t CAPACITY = 1 << 20;
+
+		explicit BufferedWriter(FILE* out);
+
+		// Room for at least bytes (at most CAPACITY) at the returned pointer;
+		// commit() the end of what was written there.
+		char* reserve(size_t bytes);
+		void commit(char* end);
+		void write(const void* data, size_t bytes);
+		void print(const char* text);
+		// Writes out the buffer. False if any write so far has failed.
+		bool flush();
+
+		bool failed() const;
+
+	private:
+		FILE* out;
+		std::vector<char> buffer;
+		size_t used;
+		bool error;
+};
+
+// Binary segment file layout, all little-endian:
+//   0  char[4] magic "MSQS"
+//   4  uint32  version, 1
+//   8  uint32  width
+//   12 uint32  height, of the raster in samples
+//   16 uint64  segment count, or UINT64_MAX when the output was not seekable
+//              and the records run to the end of the file
+//   24 records of float32 x0 y0 x1 y1 in sample coordinates, row 0 at the bottom
+static const size_t SEGMENT_HEADER_BYTES = 24;
+
+class BinarySegmentSink : public SegmentSink {
+	public:
+		BinarySegmentSink(FILE* out, int width, int height);
+
+		bool write(const segment_t *segments, size_t count);
+		bool finish();
+
+	private:
+		FILE* out;
+		BufferedWriter writer;
+		uint64_t count;
+};
+
+// A standalone SVG document in the raster's sample space, flipped so row 0
+// is at the bottom. Each batch becomes one <path>, "Mx0 y0 x1 y1" per segment.
+class SvgSegmentSink : public SegmentSink {
+	public:
+		SvgSegmentSink(FILE* out, int width, int height);
+
+		bool write(const segment_t *segments, size_t count);
+		bool finish();
+
+	private:
+		BufferedWriter writer;
+		int height;
+};
+
+// A GeoJSON FeatureCollection holding one Feature, the isoline at isovalue as
+// a MultiLineString of two-point LineStrings in sample coordinates.
+class GeoJsonSegmentSink : public SegmentSink {
+	public:
+		GeoJsonSegmentSink(FILE* out, float isovalue);
+
+		bool write(const segment_t *segments, size_t count);
+		bool finish();
+
+	private:
+		BufferedWriter writer;
+		bool first;
+};
+
+// Runs another sink on its own thread so formatting and writing overlap with
+// extraction. Batches are copied into a fixed set of buffers allocated up
+// front; write() only blocks when all of them are still queued.
+class AsyncSegmentSink : public SegmentSink {
+	public:
+		static const int BUFFERS = 4;
+
+		// sink must outlive this; batchCapacity is the largest batch copied
+		// whole, bigger ones are split.
+		AsyncSegmentSink(SegmentSink &sink, size_t batchCapacity);
+		~AsyncSegmentSink();
+
+		bool write(const segment_t *segments, size_t count);
+		// Waits for the queued batches, then finishes the wrapped sink.
+		bool finish();
+
+		// Seconds write() spent waiting for a free buffer, i.e. extraction
+		// held up by the export.
+		double getStallSeconds() const;
+
+	private:
+		void run();
+
+		SegmentSink &sink;
+		std::vector<std::vector<segment_t> > buffers;
+		std::vector<size_t> counts;
+		// buffers[head .. head + queued) are waiting for the writer thread.
+		int head, queued;
+		bool stopping, error;
+		double stalled;
+		std::mutex mutex;
+		std::condition_variable cond;
+		std::thread thread;
+};
+
+// Sink writing format ("raw", "bin", "svg" or "geojson") to out, nullptr for
+// an unknown format.
+SegmentSink* createSegmentSink(const char* format, FILE* out, int width, int height, float isovalue);
+
+#endif
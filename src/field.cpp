@@ -0,0 +1,136 @@
+#include "field.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+int boundedSide(const ScalarField &field, const grid_t &grid, int x0, int y0, int x1, int y1) {
+	const double MARGIN = 1e-3;
+	double lo, hi;
+	if(!field.bounds(grid, x0, y0, x1, y1, lo, hi))
+		return -1;
+	if(hi < 1.0 - MARGIN)
+		return 0;
+	if(lo >= 1.0 + MARGIN)
+		return 1;
+	return -1;
+}
+
+void MetaballField::evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+	// Column coordinates are divisions; do them once per grid, not per row.
+	if(xs.size() != static_cast<size_t>(grid.wQuads)) {
+		const float wf = static_cast<float>(grid.wQuads);
+		xs.resize(grid.wQuads);
+		for(int j = 0; j < grid.wQuads; j++)
+			xs[j] = sampleCoord(j, wf);
+	}
+	// Sphere-major so the inner loop vectorizes; per sample it is the same
+	// float sum, in the same order, as extractReference.
+	const float *x = xs.data() + x0;
+	const float y = sampleCoord(row, static_cast<float>(grid.hQuads));
+	std::fill(out, out + count, 0.0f);
+	for(const sphere_t &s : spheres) {
+		const float r2 = s.rad * s.rad;
+		const float dy = y - s.pos.y;
+		const float dy2 = dy * dy;
+		const float px = s.pos.x;
+		if(dx == 1) {
+			for(int k = 0; k < count; k++) {
+				const float d = x[k] - px;
+				out[k] += r2 / (d * d + dy2);
+			}
+		} else {
+			for(int k = 0; k < count; k++) {
+				const float d = x[k * dx] - px;
+				out[k] += r2 / (d * d + dy2);
+			}
+		}
+	}
+}
+
+// Each sphere's term is largest at the box point nearest its centre and
+// smallest at the farthest; a centre inside the box makes the field unbounded.
+bool MetaballField::bounds(const grid_t &grid, int ix0, int iy0, int ix1, int iy1, double &lo, double &hi) const {
+	const float wf = static_cast<float>(grid.wQuads);
+	const float hf = static_cast<float>(grid.hQuads);
+	const double x0 = sampleCoord(ix0, wf), x1 = sampleCoord(ix1, wf);
+	const double y0 = sampleCoord(iy0, hf), y1 = sampleCoord(iy1, hf);
+	lo = hi = 0.0;
+	for(const sphere_t &s : spheres) {
+		const double r2 = static_cast<double>(s.rad) * s.rad;
+		const double nx = s.pos.x < x0 ? x0 - s.pos.x : s.pos.x > x1 ? s.pos.x - x1 : 0.0;
+		const double ny = s.pos.y < y0 ? y0 - s.pos.y : s.pos.y > y1 ? s.pos.y - y1 : 0.0;
+		const double fx = std::max(std::fabs(s.pos.x - x0), std::fabs(s.pos.x - x1));
+		const double fy = std::max(std::fabs(s.pos.y - y0), std::fabs(s.pos.y - y1));
+		const double near2 = nx * nx + ny * ny;
+		if(near2 == 0.0)
+			hi = HUGE_VAL;
+		else
+			hi += r2 / near2;
+		lo += r2 / (fx * fx + fy * fy);
+	}
+	return true;
+}
+
+// The field has no local maximum away from the centres, so every inside
+// region contains one.
+bool MetaballField::interiorPoints(std::vector<vec2f> &points) const {
+	for(const sphere_t &s : spheres)
+		points.push_back(s.pos);
+	return true;
+}
+
+bool MetaballField::trackMotion(std::vector<float> &history, float *moved) const {
+	const bool known = history.size() == spheres.size() * 2;
+	*moved = 0.0f;
+	if(known) {
+		for(size_t k = 0; k < spheres.size(); k++)
+			*moved = std::max(*moved, std::max(std::fabs(spheres[k].pos.x - history[2 * k]), std::fabs(spheres[k].pos.y - history[2 * k + 1])));
+	}
+	history.resize(spheres.size() * 2);
+	for(size_t k = 0; k < spheres.size(); k++) {
+		history[2 * k] = spheres[k].pos.x;
+		history[2 * k + 1] = spheres[k].pos.y;
+	}
+	return known;
+}
+
+static inline float lattice(uint32_t seed, int x, int y) {
+	uint32_t h = seed ^ (static_cast<uint32_t>(x) * 0x27d4eb2dU) ^ (static_cast<uint32_t>(y) * 0x165667b1U);
+	h = (h ^ (h >> 15)) * 0x2c1b3c6dU;
+	h = (h ^ (h >> 12)) * 0x297a2d39U;
+	h ^= h >> 15;
+	return static_cast<float>(h & 0xFFFFFF) / static_cast<float>(0x800000) - 1.0f;
+}
+
+float NoiseField::noise(float x, float y) const {
+	const float fx = std::floor(x), fy = std::floor(y);
+	const int ix = static_cast<int>(fx), iy = static_cast<int>(fy);
+	float tx = x - fx, ty = y - fy;
+	tx = tx * tx * (3.0f - 2.0f * tx);
+	ty = ty * ty * (3.0f - 2.0f * ty);
+	const float a = lattice(seed, ix, iy), b = lattice(seed, ix + 1, iy);
+	const float c = lattice(seed, ix, iy + 1), d = lattice(seed, ix + 1, iy + 1);
+	return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * ty;
+}
+
+void NoiseField::evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+	const float wf = static_cast<float>(grid.wQuads);
+	const float y = sampleCoord(row, static_cast<float>(grid.hQuads));
+	for(int k = 0; k < count; k++) {
+		const float x = sampleCoord(x0 + k * dx, wf);
+		float sum = 0.0f, amp = 0.5f, freq = frequency;
+		for(int o = 0; o < octaves; o++) {
+			sum += amp * noise(x * freq, y * freq);
+			amp *= 0.5f;
+			freq *= 2.0f;
+		}
+		out[k] = 1.0f + sum;
+	}
+}
+
+void CallbackField::evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+	const float wf = static_cast<float>(grid.wQuads);
+	const float y = sampleCoord(row, static_cast<float>(grid.hQuads));
+	for(int k = 0; k < count; k++)
+		out[k] = fn(sampleCoord(x0 + k * dx, wf), y);
+}
@@ -0,0 +1,142 @@
+#ifndef __FIELD_HPP__
+#define __FIELD_HPP__
+
+#include "contour.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// What the contour engines sample. Samples are addressed by grid lattice
+// index; an isoline separates samples below 1 from the rest. evaluate()
+// fills a whole run of a row per call so the virtual dispatch is paid once
+// per row, not once per sample.
+class ScalarField {
+	public:
+		virtual ~ScalarField() {}
+
+		// out[k] = field at lattice point (x0 + k * dx, row), k < count.
+		virtual void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const = 0;
+
+		// Range of the field over lattice box [x0, x1] x [y0, y1], borders
+		// included; false if the field cannot bound it.
+		virtual bool bounds(const grid_t &grid, int x0, int y0, int x1, int y1, double &lo, double &hi) const { return false; }
+		// Points (NDC) such that every closed isoline around an inside region
+		// encloses one; false if the field has none.
+		virtual bool interiorPoints(std::vector<vec2f> &points) const { return false; }
+		// Sets *moved to how far (NDC) any feature moved since the state saved
+		// in history, then saves the current state there. False if that cannot
+		// be bounded, e.g. on the first call or after features were added.
+		virtual bool trackMotion(std::vector<float> &history, float *moved) const { return false; }
+};
+
+// Side of the isoline the field is provably on over lattice box [x0, x1] x
+// [y0, y1]: 0 below, 1 at or above, -1 if it may cross or cannot be bounded.
+// Fields bound in double but sample in float; the margin keeps rounding from
+// ever putting a sample on the other side of the box's answer.
+int boundedSide(const ScalarField &field, const grid_t &grid, int x0, int y0, int x1, int y1);
+
+// Sum of r^2 / d^2 over the spheres, the original field. Does not copy them,
+// so one instance follows the spheres from frame to frame. Caches the column
+// coordinates until the grid width changes: keep one per thread for as long
+// as the spheres live, not one per frame.
+class MetaballField : public ScalarField {
+	public:
+		explicit MetaballField(const std::vector<sphere_t> &spheres) : spheres(spheres) {}
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const;
+		bool bounds(const grid_t &grid, int x0, int y0, int x1, int y1, double &lo, double &hi) const;
+		bool interiorPoints(std::vector<vec2f> &points) const;
+		bool trackMotion(std::vector<float> &history, float *moved) const;
+
+	private:
+		const std::vector<sphere_t> &spheres;
+		mutable std::vector<float> xs;
+};
+
+// field + 1 - isovalue, which moves the isoline of field from 1, where the
+// engines contour, to isovalue. Everything else passes through.
+class IsovalueField : public ScalarField {
+	public:
+		IsovalueField(const ScalarField &field, float isovalue) : field(field), shift(1.0f - isovalue) {}
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+			field.evaluate(grid, row, x0, dx, count, out);
+			for(int k = 0; k < count; k++)
+				out[k] += shift;
+		}
+		bool bounds(const grid_t &grid, int x0, int y0, int x1, int y1, double &lo, double &hi) const {
+			if(!field.bounds(grid, x0, y0, x1, y1, lo, hi))
+				return false;
+			lo += shift;
+			hi += shift;
+			return true;
+		}
+		bool interiorPoints(std::vector<vec2f> &points) const { return field.interiorPoints(points); }
+		bool trackMotion(std::vector<float> &history, float *moved) const { return field.trackMotion(history, moved); }
+
+	private:
+		const ScalarField &field;
+		float shift;
+};
+
+// Row-major samples, e.g. terrain or sensor data, stretched over the grid
+// with nearest-neighbour lookup. data is the row at the bottom of the grid
+// and stride is in samples; a negative stride reads rows stored top first.
+// T only needs to convert to float, so packed or byte-swapped samples can be
+// read in place. Does not copy data.
+template <typename T>
+class RasterField : public ScalarField {
+	public:
+		RasterField(const T *data, int width, int height, ptrdiff_t stride, float scale = 1.0f, float offset = 0.0f)
+			: data(data), width(width), height(height), stride(stride), scale(scale), offset(offset) {}
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+			const T *line = data + static_cast<ptrdiff_t>(static_cast<int64_t>(row) * height / grid.hQuads) * stride;
+			// One sample per lattice point, as when contouring at the raster's own resolution.
+			if(width == grid.wQuads && dx == 1){
+				for(int k = 0; k < count; k++)
+					out[k] = line[x0 + k] * scale + offset;
+				return;
+			}
+			for(int k = 0; k < count; k++)
+				out[k] = line[static_cast<int64_t>(x0 + k * dx) * width / grid.wQuads] * scale + offset;
+		}
+
+	private:
+		const T *data;
+		int width, height;
+		ptrdiff_t stride;
+		float scale, offset;
+};
+
+// Fractal value noise around 1, so the isolines are its zero crossings.
+class NoiseField : public ScalarField {
+	public:
+		NoiseField(uint32_t seed, float frequency, int octaves) : seed(seed), frequency(frequency), octaves(octaves) {}
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const;
+
+	private:
+		float noise(float x, float y) const;
+
+		uint32_t seed;
+		float frequency;
+		int octaves;
+};
+
+// A user function of NDC position, one call per sample.
+class CallbackField : public ScalarField {
+	public:
+		typedef std::function<float(float x, float y)> field_fn;
+
+		explicit CallbackField(field_fn fn) : fn(fn) {}
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const;
+
+	private:
+		field_fn fn;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "glext.hpp"
+
+#include <cstring>
+
+PFNGLBUFFERSTORAGEPROC glext_glBufferStorage = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glext_glMaxShaderCompilerThreadsKHR = nullptr;
+
+bool GLEXT_buffer_storage = false;
+bool GLEXT_parallel_shader_compile = false;
+
+static bool versionAtLeast(int major, int minor){
+	GLint ctxMajor = 0, ctxMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &ctxMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &ctxMinor);
+	return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
+
+bool hasGLExtension(const char* name){
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for(GLint i = 0; i < count; i++){
+		const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if(ext && strcmp(ext, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+int loadGLExtensions(GLADloadproc load){
+	glext_glBufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(load("glBufferStorage"));
+	GLEXT_buffer_storage = glext_glBufferStorage && (versionAtLeast(4, 4) || hasGLExtension("GL_ARB_buffer_storage"));
+	glext_glMaxShaderCompilerThreadsKHR = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load("glMaxShaderCompilerThreadsKHR"));
+	GLEXT_parallel_shader_compile = glext_glMaxShaderCompilerThreadsKHR && hasGLExtension("GL_KHR_parallel_shader_compile");
+	return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef __GLEXT_HPP__
+#define __GLEXT_HPP__
+
+#include "glad/glad.h"
+
+// GLAD in ext/ was generated for core 4.3; entry points from newer versions
+// and extensions are declared here and resolved with the same loader.
+
+#ifndef GL_VERSION_4_4
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+#endif
+extern PFNGLBUFFERSTORAGEPROC glext_glBufferStorage;
+#define glBufferStorage glext_glBufferStorage
+
+#ifndef GL_KHR_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR glext_glMaxShaderCompilerThreadsKHR
+
+// Set by loadGLExtensions() when the entry point and the version/extension backing it are both present.
+extern bool GLEXT_buffer_storage;
+extern bool GLEXT_parallel_shader_compile;
+
+int loadGLExtensions(GLADloadproc load);
+bool hasGLExtension(const char* name);
+
+#endif
@@ -0,0 +1,116 @@
+#include "job_graph.hpp"
+
+#include <chrono>
+
+JobGraph::JobGraph(int workers, int stages) : busyNanos(stages), stopping(false) {
+	for(auto &b : busyNanos)
+		b = 0;
+	for(int i = 0; i < workers; i++)
+		threads.emplace_back(&JobGraph::workerLoop, this);
+}
+
+JobGraph::~JobGraph(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workCond.notify_all();
+	for(std::thread &t : threads)
+		t.join();
+}
+
+int JobGraph::getWorkers() const {
+	return static_cast<int>(threads.size());
+}
+
+JobGraph::node_handle JobGraph::add(int stage, int tasks, bool mainThread, job_fn fn, std::initializer_list<node_handle> deps){
+	node_handle node = std::make_shared<node_t>();
+	node->stage = stage;
+	node->tasks = tasks;
+	node->mainThread = mainThread;
+	node->fn = fn;
+	node->pendingDeps = 0;
+	node->pendingTasks = tasks;
+	node->done = false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const node_handle &dep : deps){
+		if(dep && !dep->done){
+			dep->successors.push_back(node);
+			node->pendingDeps++;
+		}
+	}
+	if(node->pendingDeps == 0)
+		enqueue(node);
+	return node;
+}
+
+// Called with the mutex held.
+void JobGraph::enqueue(const node_handle &node){
+	std::deque<task_t> &queue = node->mainThread ? mainQueue : workQueue;
+	for(int i = 0; i < node->tasks; i++)
+		queue.push_back({node, i});
+	if(node->mainThread)
+		mainCond.notify_all();
+	else
+		workCond.notify_all();
+}
+
+void JobGraph::complete(const node_handle &node){
+	std::lock_guard<std::mutex> lock(mutex);
+	node->done = true;
+	for(const node_handle &succ : node->successors){
+		if(--succ->pendingDeps == 0)
+			enqueue(succ);
+	}
+	node->successors.clear();
+	mainCond.notify_all();
+}
+
+void JobGraph::runTask(const task_t &task){
+	auto start = std::chrono::steady_clock::now();
+	task.node->fn(task.index);
+	busyNanos[task.node->stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	if(--task.node->pendingTasks == 0)
+		complete(task.node);
+}
+
+void JobGraph::workerLoop(){
+	for(;;){
+		task_t task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			workCond.wait(lock, [this]{ return stopping || !workQueue.empty(); });
+			if(stopping)
+				return;
+			task = workQueue.front();
+			workQueue.pop_front();
+		}
+		runTask(task);
+	}
+}
+
+double JobGraph::wait(const node_handle &node){
+	double blocked = 0.0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!node->done){
+		if(!mainQueue.empty()){
+			task_t task = mainQueue.front();
+			mainQueue.pop_front();
+			lock.unlock();
+			runTask(task);
+			lock.lock();
+			continue;
+		}
+		auto start = std::chrono::steady_clock::now();
+		mainCond.wait(lock);
+		blocked += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return blocked;
+}
+
+void JobGraph::takeBusy(std::vector<double> &busy){
+	busy.resize(busyNanos.size());
+	for(size_t i = 0; i < busyNanos.size(); i++)
+		busy[i] = busyNanos[i].exchange(0) * 1e-9;
+}
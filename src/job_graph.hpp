@@ -0,0 +1,67 @@
+#ifndef __JOB_GRAPH_HPP__
+#define __JOB_GRAPH_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Dependency graph of jobs run by a fixed pool of worker threads. A node runs
+// fn(0) .. fn(tasks - 1), possibly in parallel, once every dependency has
+// completed. Nodes marked mainThread are not given to the workers; the thread
+// that owns the GL context runs them from wait().
+class JobGraph {
+	public:
+		typedef std::function<void(int task)> job_fn;
+
+		struct node_t {
+			int stage;
+			int tasks;
+			bool mainThread;
+			job_fn fn;
+			int pendingDeps;
+			std::atomic<int> pendingTasks;
+			bool done;
+			std::vector<std::shared_ptr<node_t> > successors;
+		};
+		typedef std::shared_ptr<node_t> node_handle;
+
+		JobGraph(int workers, int stages);
+		~JobGraph();
+
+		node_handle add(int stage, int tasks, bool mainThread, job_fn fn, std::initializer_list<node_handle> deps);
+		// Runs ready main-thread nodes until node has completed. Returns the
+		// seconds spent blocked with nothing to run.
+		double wait(const node_handle &node);
+
+		int getWorkers() const;
+		// Busy seconds per stage since the last call, summed over threads.
+		void takeBusy(std::vector<double> &busy);
+
+	private:
+		struct task_t {
+			node_handle node;
+			int index;
+		};
+
+		void workerLoop();
+		void runTask(const task_t &task);
+		void enqueue(const node_handle &node);
+		void complete(const node_handle &node);
+
+		std::mutex mutex;
+		std::condition_variable workCond;
+		std::condition_variable mainCond;
+		std::deque<task_t> workQueue;
+		std::deque<task_t> mainQueue;
+		std::vector<std::thread> threads;
+		std::vector<std::atomic<long long> > busyNanos;
+		bool stopping;
+};
+
+#endif
@@ -1,235 +1,682 @@
 #include "glad/glad.h"
-#include <GLFW/glfw3.h>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <chrono>
+#include <cstring>
 #include <ctime>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
 #include <vector>
 #include "shader.hpp"
-
-struct vec3f{
-	float x;
-	float y;
-	float z;
-};
-struct vec2f{
-	float x;
-	float y;
-};
-struct sphere_t {
-	vec2f pos;
-	vec2f vel;
-	float rad;
-	float dist(float x, float y){
-		return ((rad*rad)/((x - pos.x)*(x - pos.x) + (y - pos.y)*(y - pos.y)));
-	};
-};
+#include "contour.hpp"
+#include "field.hpp"
+#include "oracle.hpp"
+#include "glext.hpp"
+#include "ring_buffer.hpp"
+#include "context.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+#include "sim_thread.hpp"
+#include "pipeline.hpp"
+#include "resolution.hpp"
+#include "raster.hpp"
+#include "stream.hpp"
+#include "tiled.hpp"
+#include "span_index.hpp"
+#include "archive.hpp"
 
 int g_winWidth = 1000.0f;
 int g_winHeight = 1000.0f;
 int g_res = 3;
 
-std::vector<vec3f> g_isolines;
-GLuint g_isolineVBO, g_isolineVAO;
+RingBuffer* g_isolineRing = nullptr;
+size_t g_isolineCount = 0;
+grid_t g_isolineGrid;
+ContourEngine* g_engine = nullptr;
+// Contoured instead of the metaballs when set.
+Raster* g_raster = nullptr;
+// Tile decode failures already reported, see flagFailedTiles.
+uint64_t g_failedTiles = 0;
+// --engine span: the raster's span-space index, rebuilt when the grid changes.
+SpanIndex* g_spanIndex = nullptr;
+float g_isovalue = 1.0f;
+// --record appends every contour uploaded; --replay draws an archive instead
+// of extracting.
+ArchiveWriter* g_recorder = nullptr;
+std::vector<vertex_t> g_recordVerts;
+ArchiveReader* g_replay = nullptr;
+// --fill: the inside of the contour as triangles, emitted in the line pass.
+bool g_fill = false;
+fill_mesh_t g_fillMesh;
+std::vector<float> g_fillValues;
+std::vector<uint8_t> g_fillStates;
+stats_band_t g_fillBand;
+contour_stats_t g_fillStats;
+GLuint g_fillVAO;
+// The fill mesh streams like the lines, vertices and indices in rings of their own.
+RingBuffer* g_fillVertexRing = nullptr;
+RingBuffer* g_fillIndexRing = nullptr;
+size_t g_fillCount = 0;
+GLuint g_isolineVAO;
+Profiler g_profiler;
 
 std::vector<sphere_t> spheres;
+const MetaballField g_metaballs(spheres);
+
+Context* initGL(bool headless);
+std::string shaderCacheDir();
+double setupGrid();
+bool replayFrame(int frame);
+void uploadContour(const grid_t &grid, const std::vector<vertex_t> &verts);
+void bindIsolineBuffer();
+void bindFillBuffers();
+void uploadFill();
+static bool contourStats(const FramePipeline* pipeline, contour_stats_t &stats);
+
+int main(int argc, char** argv) {
+	// scanline unless asked; --fill draws with the staged kernels.
+	const char* engineName = nullptr;
+	bool headless = false;
+	bool threaded = false;
+	int pipelineDepth = 0;
+	int workers = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+	bool shaderCache = true;
+	const char* shaderDir = nullptr;
+	int maxFrames = 0;
+	double budget = 0.0;
+	const char* rasterPath = nullptr;
+	const char* streamPath = nullptr;
+	const char* outPath = nullptr;
+	const char* format = "raw";
+	double memory = 64.0;
+	const char* tileIn = nullptr;
+	const char* tileOut = nullptr;
+	int tileSize = 256;
+	const char* codec = "none";
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	for(int i = 1; i < argc; i++){
+		if(strcmp(argv[i], "--engine") == 0 && i + 1 < argc){
+			engineName = argv[++i];
+		} else if(strcmp(argv[i], "--headless") == 0){
+			headless = true;
+		} else if(strcmp(argv[i], "--threaded") == 0){
+			threaded = true;
+		} else if(strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc){
+			pipelineDepth = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc){
+			workers = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--shader-dir") == 0 && i + 1 < argc){
+			shaderDir = argv[++i];
+		} else if(strcmp(argv[i], "--no-shader-cache") == 0){
+			shaderCache = false;
+		} else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc){
+			if(sscanf(argv[++i], "%dx%d", &g_winWidth, &g_winHeight) != 2 || g_winWidth <= 0 || g_winHeight <= 0
+					|| g_winWidth > MAX_GRID_CELLS || g_winHeight > MAX_GRID_CELLS){
+				fprintf(stderr, "ERROR: --size takes <width>x<height>\n");
+				return -1;
+			}
+		} else if(strcmp(argv[i], "--res") == 0 && i + 1 < argc){
+			g_res = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc){
+			budget = atof(argv[++i]) / 1000.0;
+		} else if(strcmp(argv[i], "--raster") == 0 && i + 1 < argc){
+			rasterPath = argv[++i];
+		} else if(strcmp(argv[i], "--isovalue") == 0 && i + 1 < argc){
+			g_isovalue = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--stream") == 0 && i + 1 < argc){
+			streamPath = argv[++i];
+		} else if(strcmp(argv[i], "--out") == 0 && i + 1 < argc){
+			outPath = argv[++i];
+		} else if(strcmp(argv[i], "--format") == 0 && i + 1 < argc){
+			format = argv[++i];
+		} else if(strcmp(argv[i], "--memory") == 0 && i + 1 < argc){
+			memory = atof(argv[++i]);
+		} else if(strcmp(argv[i], "--tile") == 0 && i + 2 < argc){
+			tileIn = argv[++i];
+			tileOut = argv[++i];
+		} else if(strcmp(argv[i], "--tile-size") == 0 && i + 1 < argc){
+			tileSize = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--codec") == 0 && i + 1 < argc){
+			codec = argv[++i];
+		} else if(strcmp(argv[i], "--fill") == 0){
+			g_fill = true;
+		} else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+			recordPath = argv[++i];
+		} else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+			replayPath = argv[++i];
+		} else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc){
+			maxFrames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "--validate") == 0 && i + 1 < argc){
+			// --validate <engine> [scenes] [seed]
+			const char* name = argv[++i];
+			int scenes = (i + 1 < argc) ? atoi(argv[++i]) : 1000;
+			unsigned int seed = (i + 1 < argc) ? strtoul(argv[++i], NULL, 10) : 1;
+			return runOracle(name, scenes, seed, 1e-5f);
+		} else {
+			fprintf(stderr, "Usage: %s [--engine <name>] [--headless] [--threaded] [--pipeline <1-3>] [--workers <n>] [--size <w>x<h>] [--res <px>] [--budget <ms>] [--raster <file>] [--isovalue <t>] [--fill] [--record <file> | --replay <file>] [--frames <n>] [--no-shader-cache] [--shader-dir <dir>] [--validate <engine> [scenes] [seed]] [--stream <raster> [--memory <MB>] [--out <file> [--format raw|bin|svg|geojson]]] [--tile <raster> <out> [--tile-size <n>] [--codec <name>]]\n", argv[0]);
+			return -1;
+		}
+	}
+	if(tileIn)
+		return runTile(tileIn, tileOut, tileSize, codec);
+	if(streamPath){
+		if(memory <= 0.0){
+			fprintf(stderr, "ERROR: --memory takes a positive number of megabytes\n");
+			return -1;
+		}
+		return runStream(streamPath, outPath, format, g_isovalue, static_cast<size_t>(memory * 1024.0 * 1024.0));
+	}
+	if(outPath){
+		fprintf(stderr, "ERROR: --out is only used with --stream\n");
+		return -1;
+	}
+
+	if(g_fill && engineName && strcmp(engineName, "staged") != 0){
+		fprintf(stderr, "ERROR: --fill always draws with the staged kernels, so it takes no --engine but staged\n");
+		return -1;
+	}
+	if(!engineName)
+		engineName = g_fill ? "staged" : "scanline";
+
+	// The span index answers queries for a static field, so it needs a raster;
+	// the scanline engine stands in for it wherever an engine is asked for.
+	if(strcmp(engineName, "span") == 0){
+		if(!rasterPath){
+			fprintf(stderr, "ERROR: --engine span needs --raster\n");
+			return -1;
+		}
+		g_spanIndex = new SpanIndex();
+		engineName = "scanline";
+	}
+	g_engine = createEngine(engineName);
+	if(!g_engine){
+		fprintf(stderr, "ERROR: unknown contour engine '%s'\n", engineName);
+		return -1;
+	}
 
-GLFWwindow* initGL();
-void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
-void setupGrid();
+	if(pipelineDepth < 0 || pipelineDepth > 3 || workers < 1 || (pipelineDepth && threaded)){
+		fprintf(stderr, "ERROR: --pipeline takes a depth of 1 to 3 and excludes --threaded, --workers must be at least 1\n");
+		return -1;
+	}
+	if(g_res < ResolutionController::MIN_RES || g_res > ResolutionController::MAX_RES || budget < 0.0){
+		fprintf(stderr, "ERROR: --res takes %d to %d pixels per cell, --budget a positive number of milliseconds\n",
+				ResolutionController::MIN_RES, ResolutionController::MAX_RES);
+		return -1;
+	}
+	if(g_fill && (threaded || pipelineDepth || replayPath)){
+		fprintf(stderr, "ERROR: --fill excludes --threaded, --pipeline and --replay\n");
+		return -1;
+	}
+	if(headless && maxFrames <= 0)
+		maxFrames = 600;
+	if(replayPath){
+		if(threaded || pipelineDepth || rasterPath || recordPath){
+			fprintf(stderr, "ERROR: --replay excludes --threaded, --pipeline, --raster and --record\n");
+			return -1;
+		}
+		g_replay = new ArchiveReader();
+		if(!g_replay->open(replayPath)){
+			delete g_replay;
+			return -1;
+		}
+		if(g_replay->getFrames() == 0){
+			fprintf(stderr, "ERROR: no frames to replay in '%s'\n", replayPath);
+			delete g_replay;
+			return -1;
+		}
+		printf("Replay: %s, %d frames\n", replayPath, g_replay->getFrames());
+	}
+	if(recordPath){
+		g_recorder = new ArchiveWriter();
+		if(!g_recorder->open(recordPath)){
+			delete g_recorder;
+			return -1;
+		}
+	}
+	if(rasterPath){
+		if(threaded || pipelineDepth){
+			fprintf(stderr, "ERROR: --raster excludes --threaded and --pipeline\n");
+			return -1;
+		}
+		g_raster = openRaster(rasterPath);
+		if(!g_raster)
+			return -1;
+		printf("Raster: %s, %dx%d %s, %.1f MB mapped\n", rasterPath, g_raster->getWidth(), g_raster->getHeight(),
+				g_raster->getFormat(), g_raster->getMappedBytes() / (1024.0 * 1024.0));
+	}
 
-int main() {
 	srand(time(NULL));
-	GLFWwindow *window = initGL();
-	if(!window){
-		fprintf(stderr, "ERROR: something bad happened during GLFW initialization, exiting...\n");
+	Context *context = initGL(headless);
+	if(!context){
+		fprintf(stderr, "ERROR: something bad happened during GL context initialization, exiting...\n");
 		return -1;
 	}
-	glfwSetKeyCallback(window, keyboardCallback);
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+	if (!gladLoadGLLoader(context->getProcLoader())) {
 		fprintf(stderr, "Failed to initialize GLAD\n");
-		glfwTerminate();
+		delete context;
 		return -1;
 	}
-
-	for(int i = 0; i < std::rand() % 30 + 1; i++){
-		float rad = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.3f);
-		float x = (std::rand() % 2 == 0) ? -1.0f + rad : 0.0f;
-		float y = (std::rand() % 2 == 0) ? 1.0f - rad : 0.0f;
-		float velx  = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.010f);
-		float vely = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.010f);
-		spheres.push_back({{x, y}, {velx, vely}, rad});
+	loadGLExtensions(context->getProcLoader());
+	if(GLEXT_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	if(!context->initFramebuffer()){
+		delete context;
+		return -1;
 	}
+	// The framebuffer, not the window, sets the grid; they differ on HiDPI displays.
+	context->getFramebufferSize(g_winWidth, g_winHeight);
+	printf("Context: %s, %s, %dx%d\n", context->name(), glGetString(GL_RENDERER), g_winWidth, g_winHeight);
+	g_profiler.initGPU();
+
+	spawnSpheres(spheres);
 
 	glGenVertexArrays(1, &g_isolineVAO);
-	glGenBuffers(1, &g_isolineVBO);
+	g_isolineRing = new RingBuffer();
+	g_isolineRing->reserve(65536 * sizeof(vertex_t));
+	bindIsolineBuffer();
+	printf("Isoline upload: %s\n", g_isolineRing->isPersistent() ? "persistent mapped ring" : "glBufferData");
+	if(g_fill){
+		glGenVertexArrays(1, &g_fillVAO);
+		g_fillVertexRing = new RingBuffer();
+		g_fillVertexRing->reserve(65536 * sizeof(vertex_t));
+		g_fillIndexRing = new RingBuffer();
+		g_fillIndexRing->reserve(65536 * sizeof(uint32_t));
+		bindFillBuffers();
+	}
 
-	// TODO: remove this dependency
 	Shader shader;
-	shader.loadShader("shaders/vert.glsl", GL_VERTEX_SHADER);
-	shader.loadShader("shaders/frag.glsl", GL_FRAGMENT_SHADER);
-	shader.compileShaders();
-	shader.use();
+	std::string cacheDir = shaderCache ? shaderCacheDir() : "";
+	shader.setBinaryCache(cacheDir.empty() ? nullptr : cacheDir.c_str());
+	shader.setSourceDir(shaderDir);
+	shader.loadShader("vert.glsl", GL_VERTEX_SHADER);
+	shader.loadShader("frag.glsl", GL_FRAGMENT_SHADER);
+	// Frames are presented (empty) until the program has finished building.
+	shader.submit();
+	bool shaderReady = false;
 
-	setupGrid();
+	ResolutionController resolution(g_res, budget);
+	int replayed = 0;
+	if(g_replay)
+		replayFrame(replayed);
+	else
+		setupGrid();
+
+	// The simulation thread gets its own engine, g_engine stays with this thread.
+	SimulationThread* simThread = nullptr;
+	if(threaded){
+		simThread = new SimulationThread(createEngine(g_engine->name()), spheres, g_winWidth, g_winHeight, g_res, g_isovalue);
+		simThread->start();
+	}
+	FramePipeline* pipeline = nullptr;
+	if(pipelineDepth > 0)
+		pipeline = new FramePipeline(pipelineDepth, workers, spheres, g_winWidth, g_winHeight, g_res, g_isovalue, uploadContour);
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glLineWidth(2.0f);
 
 	const double fpsLimit = 1.0/60.0;
-	double lastTime = glfwGetTime();
+	double lastTime = context->getTime();
 	double timer = lastTime;
+	const double startTime = lastTime;
 	double dt = 0, nowTime = 0;
-	int frames = 0, updates = 0;
-	while(!glfwWindowShouldClose(window)){
-		glfwPollEvents();
+	int frames = 0, updates = 0, dropped = 0, totalFrames = 0;
+	while(!context->shouldClose() && (maxFrames <= 0 || totalFrames < maxFrames)){
+		context->pollEvents();
+		g_profiler.beginFrame();
+
+		// A minimized window reports 0x0; keep drawing the last grid until it comes back.
+		int fbWidth, fbHeight;
+		if(context->takeResize(fbWidth, fbHeight) && fbWidth > 0 && fbHeight > 0){
+			g_winWidth = fbWidth;
+			g_winHeight = fbHeight;
+			if(simThread)
+				simThread->setSize(g_winWidth, g_winHeight);
+			if(pipeline)
+				pipeline->setSize(g_winWidth, g_winHeight);
+		}
+
+		// Up and down sweep the isovalue, in 64ths of the field's range when
+		// it is known.
+		bool contourChanged = false;
+		int arrowSteps = context->takeArrowSteps();
+		if(arrowSteps && g_replay){
+			// Replaying, they seek a second of frames instead.
+			replayed += arrowSteps * 60;
+			arrowSteps = 0;
+			contourChanged = true;
+		}
+		if(arrowSteps){
+			float lo, hi;
+			float step = (g_spanIndex && g_spanIndex->getRange(lo, hi) && hi > lo) ? (hi - lo) / 64.0f : 0.05f;
+			g_isovalue += arrowSteps * step;
+			if(simThread)
+				simThread->setIsovalue(g_isovalue);
+			if(pipeline)
+				pipeline->setIsovalue(g_isovalue);
+			contourChanged = true;
+			printf("Isovalue: %g\n", g_isovalue);
+		}
 
-		nowTime = glfwGetTime();
+		nowTime = context->getTime();
 		dt += (nowTime - lastTime) / fpsLimit;
 		lastTime = nowTime;
 
-		while(dt >= 1.0){
-			for(auto &s : spheres){
-				if(s.pos.x - s.rad < -1 || s.pos.x + s.rad > 1) s.vel.x = -s.vel.x;
-				if(s.pos.y - s.rad < -1 || s.pos.y + s.rad > 1) s.vel.y = -s.vel.y;
-				s.pos.x += s.vel.x * dt;
-				s.pos.y += s.vel.y * dt;
+		if(simThread){
+			// Always draw the newest finished contour; never wait for one.
+			if(simThread->acquire()){
+				const contour_frame_t &frame = simThread->latest();
+				uploadContour(frame.grid, frame.verts);
+				g_profiler.addTime(ZONE_SIMULATE, frame.simulateTime);
+				g_profiler.addTime(ZONE_EXTRACT, frame.extractTime);
+				simThread->setResolution(resolution.update(frame.extractTime));
 			}
-			setupGrid();
-
-			updates++;
-			dt--;
+			updates += simThread->takeSteps();
+			dropped += simThread->takeDropped();
+		}
+		if(pipeline){
+			updates += pipeline->advance();
+			dropped += pipeline->takeDropped();
+			pipeline->setResolution(resolution.update(pipeline->getExtractTime()));
+		}
+		if(g_replay){
+			// One recorded frame per tick, looping.
+			int steps = advanceSimulation(spheres, dt, dropped);
+			if(steps > 0 || contourChanged){
+				const int frames = g_replay->getFrames();
+				replayed = ((replayed + steps) % frames + frames) % frames;
+				if(!replayFrame(replayed))
+					break;
+			}
+			updates += steps;
+		} else if(!simThread && !pipeline){
+			// Physics catches up in fixed steps, but only the last state is
+			// drawn, so it is contoured once per frame.
+			g_profiler.beginZone(ZONE_SIMULATE);
+			int steps = advanceSimulation(spheres, dt, dropped);
+			g_profiler.endZone(ZONE_SIMULATE);
+			if(steps > 0 || contourChanged)
+				g_res = resolution.update(setupGrid());
+			updates += steps;
 		}
 		
+		g_profiler.beginZone(ZONE_DRAW);
 		glClear(GL_COLOR_BUFFER_BIT);
 		glViewport(0, 0, g_winWidth, g_winHeight);
 
-		glBindVertexArray(g_isolineVAO);
-		glDrawArrays(GL_LINES, 0, g_isolines.size());
-		glBindVertexArray(0);
+		if(!shaderReady && shader.poll()){
+			shaderReady = true;
+			shader.use();
+			printf("Shaders: ready in %.3f ms, %.3f ms blocking, frame %d (%s%s)\n", shader.getBuildTime() * 1000.0,
+					shader.getSubmitTime() * 1000.0, totalFrames,
+					cacheDir.empty() ? "binary cache disabled" : shader.isFromCache() ? "binary cache hit" : "compiled, binary cached",
+					GLEXT_parallel_shader_compile ? ", parallel compile" : "");
+		}
+		if(shaderReady){
+			vec2f scale = quantScale(g_isolineGrid);
+			shader.setVec2("uScale", scale.x, scale.y);
+			shader.setVec2("uOffset", -1.0f, -1.0f);
+			// The fill goes underneath, in the lines' colour but dimmer.
+			if(g_fillCount > 0){
+				shader.setVec4("uColor", 0.0f, 0.3f, 0.0f, 1.0f);
+				glBindVertexArray(g_fillVAO);
+				glDrawElements(GL_TRIANGLES, g_fillCount, GL_UNSIGNED_INT, reinterpret_cast<const void*>(g_fillIndexRing->getDrawOffset()));
+				g_fillVertexRing->fence();
+				g_fillIndexRing->fence();
+			}
+			shader.setVec4("uColor", 0.0f, 1.0f, 0.0f, 1.0f);
+			glBindVertexArray(g_isolineVAO);
+			glDrawArrays(GL_LINES, g_isolineRing->getDrawOffset() / sizeof(vertex_t), g_isolineCount);
+			glBindVertexArray(0);
+			g_isolineRing->fence();
+		}
+		g_profiler.endZone(ZONE_DRAW);
 
-		glfwSwapBuffers(window);
+		g_profiler.beginZone(ZONE_SWAP);
+		context->swapBuffers();
+		g_profiler.endZone(ZONE_SWAP);
+		g_profiler.endFrame();
 		
 		frames++;
+		totalFrames++;
 		// - Reset after one second
-		if (glfwGetTime() - timer > 1.0) {
+		if (context->getTime() - timer > 1.0) {
 			timer ++;
-			printf("FPS: %d Updates: %d\n", frames, updates);
-			updates = 0, frames = 0;
+			printf("FPS: %d Updates: %d Dropped: %d\n", frames, updates, dropped);
+			g_profiler.report(stdout);
+			resolution.report(stdout);
+			if(pipeline)
+				pipeline->report(stdout);
+			contour_stats_t stats;
+			if(!simThread && contourStats(pipeline, stats)){
+				const int cells = (g_isolineGrid.wQuads - 1) * (g_isolineGrid.hQuads - 1);
+				printf("  contour: area %.1f cells (%.1f%%), length %.1f cells, %d components\n", stats.area,
+						cells > 0 ? 100.0 * stats.area / cells : 0.0, stats.length, stats.components);
+			}
+			updates = 0, frames = 0, dropped = 0;
 		}
 	}
 
-	glfwTerminate();
-}
-
-GLFWwindow* initGL(){
-	if(!glfwInit()){
-		fprintf(stderr, "ERROR: cannot start GLFW3\n");
-		return nullptr;
+	if(maxFrames > 0){
+		double elapsed = context->getTime() - startTime;
+		printf("Frames: %d in %.3fs, %.3f ms/frame\n", totalFrames, elapsed, totalFrames ? elapsed * 1000.0 / totalFrames : 0.0);
+		g_profiler.report(stdout);
 	}
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_SAMPLES, 4);
 
-	GLFWwindow* window = glfwCreateWindow(g_winWidth, g_winHeight, "MarchingSquares", NULL, NULL);
-	if(!window) {
-		fprintf(stderr, "ERROR: could not create GLFW3 window\n");
-		return nullptr;
+	delete pipeline;
+	delete simThread;
+	// After the pipeline, which uploads the frames still in flight.
+	if(g_recorder){
+		const uint64_t stored = g_recorder->getStoredBytes();
+		printf("Recorded: %d frames, %.2f MB, %.1fx smaller than the vertices, %.3f ms/frame encoding\n", g_recorder->getFrames(),
+				stored / (1024.0 * 1024.0), stored ? static_cast<double>(g_recorder->getRawBytes()) / stored : 0.0,
+				g_recorder->getFrames() ? g_recorder->getEncodeSeconds() * 1000.0 / g_recorder->getFrames() : 0.0);
+		if(!g_recorder->close())
+			fprintf(stderr, "ERROR: writing '%s' failed\n", recordPath);
 	}
-	glfwMakeContextCurrent(window);
-	return window;
+	if(g_fill){
+		delete g_fillVertexRing;
+		delete g_fillIndexRing;
+		glDeleteVertexArrays(1, &g_fillVAO);
+	}
+	delete g_isolineRing;
+	delete g_engine;
+	delete g_spanIndex;
+	delete g_recorder;
+	delete g_replay;
+	delete g_raster;
+	delete context;
 }
 
-void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if (key == GLFW_KEY_ESCAPE)
-		glfwSetWindowShouldClose(window, 1);
+Context* initGL(bool headless){
+	if(headless)
+		return createHeadlessContext(g_winWidth, g_winHeight);
+	return createWindowContext(g_winWidth, g_winHeight, "MarchingSquares");
 }
 
-int getState(int a, int b, int c, int d) {
-	return d + c * 2 + b * 4 + a * 8;
+// $XDG_CACHE_HOME/MarchingSquaresGL or ~/.cache/MarchingSquaresGL, empty if neither is usable.
+std::string shaderCacheDir() {
+	std::string dir;
+	if(const char* xdg = getenv("XDG_CACHE_HOME"))
+		dir = xdg;
+	else if(const char* home = getenv("HOME"))
+		dir = std::string(home) + "/.cache";
+	else
+		return "";
+	mkdir(dir.c_str(), 0755);
+	dir += "/MarchingSquaresGL";
+	if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+		return "";
+	return dir;
 }
 
-void setupGrid() {
-	g_isolines.clear();
-	float wQuads = g_winWidth / g_res + 1;
-	float hQuads = g_winHeight/ g_res + 1;
-	float quadHeight = 2.0f/static_cast<float>(hQuads);
-	float quadWidth = 2.0f/static_cast<float>(wQuads);
-	std::vector<int> val(wQuads * hQuads);
-	for(int i = 0; i < hQuads; i++) {
-		float y = 2.0f * static_cast<float>(i) / hQuads - 1.0f;
-		for(int j = 0; j < wQuads; j++) {
-			float x = 2.0f * static_cast<float>(j) / wQuads - 1.0f;
-			float res = 0.0f; 
-			for(auto s : spheres)
-				res += s.dist(x, y);
-			val[j * wQuads + i] = res < 1 ? 0 : 1;
-		}
-	}
-	for(int i = 0; i < hQuads - 1; i++) {
-		float y = 2.0f * static_cast<float>(i) / hQuads - 1.0f;
-		for(int j = 0; j < wQuads - 1; j++) {
-			float x = 2.0f * static_cast<float>(j) / wQuads - 1.0f;
-			int a = val[j * wQuads + i];
-			int b = val[j * wQuads + i+1];
-			int c = val[(j+1) * wQuads + (i+1)];
-			int d = val[(j+1) * wQuads + i];
-			int state = getState(a, b, c, d);
-			switch(state){
-				case 0:
-				case 15:
-					break;
-				case 1:
-				case 14:
-						g_isolines.push_back({x + quadWidth / 2.0f, y, 0.0f});
-						g_isolines.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
-					break;
-				case 2:
-				case 13:
-						g_isolines.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
-						g_isolines.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
-					break;
-				case 3:
-				case 12:
-						g_isolines.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
-						g_isolines.push_back({x + quadWidth / 2.0f, y, 0.0f});
-					break;
-				case 4:
-				case 11:
-					g_isolines.push_back({x, y + quadHeight / 2.0f, 0.0f});
-					g_isolines.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
-					break;
-				case 5:
-					g_isolines.push_back({x, y + quadHeight / 2.0f, 0.0f});
-					g_isolines.push_back({x + quadWidth / 2.0f, y, 0.0f});
-					g_isolines.push_back({x+ quadWidth / 2.0f, y + quadHeight, 0.0f});
-					g_isolines.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
-					break;
-				case 6:
-				case 9:
-					g_isolines.push_back({x, y + quadHeight / 2.0f, 0.0f});
-					g_isolines.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
-					break;
-				case 7:
-				case 8:
-					g_isolines.push_back({x, y + quadHeight / 2.0f, 0.0f});
-					g_isolines.push_back({x + quadWidth / 2.0f, y, 0.0f});
-					break;
-				case 10:
-					g_isolines.push_back({x, y + quadWidth / 2.0f, 0.0f});
-					g_isolines.push_back({x + quadWidth / 2.0f, y + quadHeight, 0.0f});
-					g_isolines.push_back({x+ quadWidth / 2.0f, y, 0.0f});
-					g_isolines.push_back({x + quadWidth, y + quadHeight / 2.0f, 0.0f});
-					break;
-			}
-		}
-	}
+void bindIsolineBuffer() {
 	glBindVertexArray(g_isolineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, g_isolineVBO);
-	glBufferData(GL_ARRAY_BUFFER, g_isolines.size() * sizeof(vec3f), &g_isolines[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, g_isolineRing->getID());
 
 	// Position;
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, NULL);
 	glBindVertexArray(0);
 }
+
+// Copies a contour produced off-thread into the ring's next region.
+void uploadContour(const grid_t &grid, const std::vector<vertex_t> &verts) {
+	g_profiler.beginZone(ZONE_UPLOAD);
+	if(g_isolineRing->reserve(verts.size() * sizeof(vertex_t)))
+		bindIsolineBuffer();
+	void* dst = g_isolineRing->beginWrite();
+	memcpy(dst, verts.data(), verts.size() * sizeof(vertex_t));
+	g_isolineRing->commit(verts.size() * sizeof(vertex_t));
+	g_profiler.endZone(ZONE_UPLOAD);
+	g_isolineCount = verts.size();
+	g_isolineGrid = grid;
+	if(g_recorder)
+		g_recorder->append(grid, verts);
+}
+
+// Points the fill VAO at the regions last committed to the fill rings. The
+// indices start at the vertex region, so its offset goes in the attribute.
+void bindFillBuffers() {
+	glBindVertexArray(g_fillVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, g_fillVertexRing->getID());
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_fillIndexRing->getID());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, reinterpret_cast<const void*>(g_fillVertexRing->getDrawOffset()));
+	glBindVertexArray(0);
+}
+
+// Copies g_fillMesh into the fill rings' next regions.
+void uploadFill() {
+	g_profiler.beginZone(ZONE_UPLOAD);
+	const size_t vertexBytes = g_fillMesh.vertices.size() * sizeof(vertex_t);
+	const size_t indexBytes = g_fillMesh.indices.size() * sizeof(uint32_t);
+	g_fillVertexRing->reserve(vertexBytes);
+	g_fillIndexRing->reserve(indexBytes);
+	memcpy(g_fillVertexRing->beginWrite(), g_fillMesh.vertices.data(), vertexBytes);
+	g_fillVertexRing->commit(vertexBytes);
+	memcpy(g_fillIndexRing->beginWrite(), g_fillMesh.indices.data(), indexBytes);
+	g_fillIndexRing->commit(indexBytes);
+	bindFillBuffers();
+	g_profiler.endZone(ZONE_UPLOAD);
+	g_fillCount = g_fillMesh.indices.size();
+}
+
+// Decodes frame of the replayed archive and uploads it.
+bool replayFrame(int frame) {
+	grid_t grid;
+	if(!g_replay->read(frame, grid, g_recordVerts)){
+		fprintf(stderr, "ERROR: frame %d of the archive is damaged\n", frame);
+		return false;
+	}
+	uploadContour(grid, g_recordVerts);
+	return true;
+}
+
+// The lines through the staged kernels, which fill g_fillMesh in the same pass.
+static void extractFilled(const grid_t &grid, const ScalarField &field, vertex_writer_t &writer) {
+	growBuffer(g_fillValues, static_cast<size_t>(grid.wQuads) * grid.hQuads);
+	growBuffer(g_fillStates, static_cast<size_t>(grid.wQuads - 1) * (grid.hQuads - 1));
+	evaluateField(grid, field, g_fillValues.data(), 0, grid.hQuads);
+	classifyCells(grid, g_fillValues.data(), g_fillStates.data(), 0, grid.hQuads - 1, g_fillBand);
+	emitCellsFilled(grid, g_fillStates.data(), writer, g_fillMesh);
+	g_fillStats = reduceStats(&g_fillBand, 1);
+}
+
+// Statistics of the contour drawn, gathered during its extraction; false if
+// it came from somewhere that does not gather them.
+static bool contourStats(const FramePipeline* pipeline, contour_stats_t &stats) {
+	if(pipeline) {
+		stats = pipeline->getStats();
+		return true;
+	}
+	if(g_replay || g_spanIndex)
+		return false;
+	if(g_fill) {
+		stats = g_fillStats;
+		return true;
+	}
+	return g_engine->getStats(stats);
+}
+
+// Reports tiles of g_raster that failed to decode since the last call: what
+// was just contoured from them is wrong, and the frame must say so.
+static void flagFailedTiles(const char* what) {
+	if(!g_raster || g_raster->getFailedTiles() == g_failedTiles)
+		return;
+	fprintf(stderr, "ERROR: %s is incomplete, %llu tile decodes failed\n", what,
+			static_cast<unsigned long long>(g_raster->getFailedTiles() - g_failedTiles));
+	g_failedTiles = g_raster->getFailedTiles();
+}
+
+// The current contour at g_isovalue.
+static void extractContour(const grid_t &grid, vertex_writer_t &writer) {
+	if(g_spanIndex)
+		g_spanIndex->query(g_isovalue, writer);
+	else if(g_raster && g_fill)
+		extractFilled(grid, IsovalueField(g_raster->getField(), g_isovalue), writer);
+	else if(g_raster)
+		g_engine->extract(grid, IsovalueField(g_raster->getField(), g_isovalue), writer);
+	else if(g_fill)
+		extractFilled(grid, IsovalueField(g_metaballs, g_isovalue), writer);
+	else
+		g_engine->extract(grid, IsovalueField(g_metaballs, g_isovalue), writer);
+	flagFailedTiles("this frame");
+}
+
+// Extracts straight into the ring's next region; if the contour does not fit,
+// the ring grows and the extraction is repeated. Returns the extraction time.
+double setupGrid() {
+	grid_t grid = makeGrid(g_winWidth, g_winHeight, g_res);
+	if(g_spanIndex && !g_spanIndex->covers(grid)){
+		std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+		g_spanIndex->build(grid, g_raster->getField());
+		flagFailedTiles("the span index");
+		printf("Span index: %dx%d grid, %zu of %zu blocks spanning, %.1f MB, built in %.3f ms\n", grid.wQuads, grid.hQuads,
+				g_spanIndex->getSpans(), g_spanIndex->getBlocks(), g_spanIndex->getBytes() / (1024.0 * 1024.0),
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count() * 1000.0);
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if(g_recorder) {
+		// The recorder reads the contour back, so it goes through memory the
+		// CPU can read quickly instead of the (possibly write-combined) ring.
+		g_recordVerts.resize(g_recordVerts.capacity() > 1024 ? g_recordVerts.capacity() : 1024);
+		for(;;) {
+			vertex_writer_t writer = makeWriter(g_recordVerts.data(), g_recordVerts.size());
+			g_profiler.beginZone(ZONE_EXTRACT);
+			extractContour(grid, writer);
+			g_profiler.endZone(ZONE_EXTRACT);
+			growBuffer(g_recordVerts, writer.count);
+			if(!writer.overflowed())
+				break;
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		uploadContour(grid, g_recordVerts);
+		if(g_fill)
+			uploadFill();
+		return seconds;
+	}
+	for(;;) {
+		g_profiler.beginZone(ZONE_UPLOAD);
+		vertex_t* dst = static_cast<vertex_t*>(g_isolineRing->beginWrite());
+		g_profiler.endZone(ZONE_UPLOAD);
+		vertex_writer_t writer = makeWriter(dst, g_isolineRing->getSlotBytes() / sizeof(vertex_t));
+		g_profiler.beginZone(ZONE_EXTRACT);
+		extractContour(grid, writer);
+		g_profiler.endZone(ZONE_EXTRACT);
+		if(!writer.overflowed()) {
+			g_profiler.beginZone(ZONE_UPLOAD);
+			g_isolineRing->commit(writer.count * sizeof(vertex_t));
+			g_profiler.endZone(ZONE_UPLOAD);
+			g_isolineCount = writer.count;
+			g_isolineGrid = grid;
+			if(g_fill)
+				uploadFill();
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		if(g_isolineRing->reserve(writer.count * sizeof(vertex_t)))
+			bindIsolineBuffer();
+	}
+}
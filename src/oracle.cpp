@@ -0,0 +1,622 @@
+#include "oracle.hpp"
+#include "contour.hpp"
+#include "field.hpp"
+#include "span_index.hpp"
+#include "archive.hpp"
+#include "simulation.hpp"
+#include "stream.hpp"
+#include "tiled.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct oracle_segment_t {
+	int cell;
+	float x0, y0;
+	float x1, y1;
+};
+
+static bool segmentLess(const oracle_segment_t &a, const oracle_segment_t &b){
+	if(a.cell != b.cell) return a.cell < b.cell;
+	if(a.x0 != b.x0) return a.x0 < b.x0;
+	if(a.y0 != b.y0) return a.y0 < b.y0;
+	if(a.x1 != b.x1) return a.x1 < b.x1;
+	return a.y1 < b.y1;
+}
+
+// Turns GL_LINES vertex pairs into segments with a canonical endpoint order,
+// tagged with the cell that contains their midpoint, sorted row-major.
+static void normalize(const grid_t &grid, const std::vector<vec3f> &verts, std::vector<oracle_segment_t> &out){
+	out.clear();
+	for(size_t k = 0; k + 1 < verts.size(); k += 2) {
+		vec3f p = verts[k];
+		vec3f q = verts[k + 1];
+		if(q.x < p.x || (q.x == p.x && q.y < p.y)) std::swap(p, q);
+		int col = static_cast<int>(std::floor(((p.x + q.x) * 0.5f + 1.0f) / grid.quadWidth));
+		int row = static_cast<int>(std::floor(((p.y + q.y) * 0.5f + 1.0f) / grid.quadHeight));
+		col = std::min(std::max(col, 0), grid.wQuads - 2);
+		row = std::min(std::max(row, 0), grid.hQuads - 2);
+		out.push_back({row * (grid.wQuads - 1) + col, p.x, p.y, q.x, q.y});
+	}
+	std::sort(out.begin(), out.end(), segmentLess);
+}
+
+static bool segmentNear(const oracle_segment_t &a, const oracle_segment_t &b, float tolerance){
+	return std::fabs(a.x0 - b.x0) <= tolerance && std::fabs(a.y0 - b.y0) <= tolerance
+		&& std::fabs(a.x1 - b.x1) <= tolerance && std::fabs(a.y1 - b.y1) <= tolerance;
+}
+
+static void printCell(const char* label, const std::vector<oracle_segment_t> &segs, size_t begin, size_t end){
+	fprintf(stderr, "  %s: %zu segment(s)\n", label, end - begin);
+	for(size_t k = begin; k < end; k++)
+		fprintf(stderr, "    (%.6f, %.6f) - (%.6f, %.6f)\n", segs[k].x0, segs[k].y0, segs[k].x1, segs[k].y1);
+}
+
+// Returns the index of the first mismatching cell, or -1 if both sets agree.
+static int compareScene(const grid_t &grid, const std::vector<oracle_segment_t> &ref, const std::vector<oracle_segment_t> &got, float tolerance, bool report){
+	size_t a = 0, b = 0;
+	while(a < ref.size() || b < got.size()) {
+		int cell;
+		if(a == ref.size()) cell = got[b].cell;
+		else if(b == got.size()) cell = ref[a].cell;
+		else cell = std::min(ref[a].cell, got[b].cell);
+
+		size_t aEnd = a, bEnd = b;
+		while(aEnd < ref.size() && ref[aEnd].cell == cell) aEnd++;
+		while(bEnd < got.size() && got[bEnd].cell == cell) bEnd++;
+
+		bool match = (aEnd - a) == (bEnd - b);
+		for(size_t k = 0; match && k < aEnd - a; k++)
+			match = segmentNear(ref[a + k], got[b + k], tolerance);
+		if(!match) {
+			if(!report) return cell;
+			fprintf(stderr, "  first mismatching cell: col %d row %d\n", cell % (grid.wQuads - 1), cell / (grid.wQuads - 1));
+			printCell("reference", ref, a, aEnd);
+			printCell("engine", got, b, bEnd);
+			return cell;
+		}
+		a = aEnd;
+		b = bEnd;
+	}
+	return -1;
+}
+
+static void randomScene(std::mt19937 &rng, grid_t &grid, std::vector<sphere_t> &spheres){
+	std::uniform_int_distribution<int> sizeDist(32, 600);
+	std::uniform_int_distribution<int> resDist(2, 6);
+	std::uniform_int_distribution<int> countDist(1, 30);
+	std::uniform_real_distribution<float> radDist(0.01f, 0.3f);
+	std::uniform_real_distribution<float> posDist(-1.0f, 1.0f);
+
+	int width = sizeDist(rng);
+	int height = sizeDist(rng);
+	grid = makeGrid(width, height, resDist(rng));
+	spheres.clear();
+	int count = countDist(rng);
+	for(int i = 0; i < count; i++)
+		spheres.push_back({{posDist(rng), posDist(rng)}, {0.0f, 0.0f}, radDist(rng)});
+}
+
+// Same contract as extractToVector, for the span index.
+static void queryToVector(const SpanIndex &index, float isovalue, std::vector<vertex_t> &out){
+	out.resize(out.capacity() > 1024 ? out.capacity() : 1024);
+	for(;;){
+		vertex_writer_t writer = makeWriter(out.data(), out.size());
+		index.query(isovalue, writer);
+		growBuffer(out, writer.count);
+		if(!writer.overflowed())
+			return;
+	}
+}
+
+// Same contract again, for the staged kernels with the fill. Cells are
+// classified in bands.size() row bands, which gather contour statistics.
+static void fillToVector(const grid_t &grid, const ScalarField &field, std::vector<float> &values, std::vector<uint8_t> &states,
+		std::vector<stats_band_t> &bands, fill_mesh_t &fill, std::vector<vertex_t> &out){
+	growBuffer(values, static_cast<size_t>(grid.wQuads) * grid.hQuads);
+	growBuffer(states, static_cast<size_t>(grid.wQuads - 1) * (grid.hQuads - 1));
+	evaluateField(grid, field, values.data(), 0, grid.hQuads);
+	const int n = static_cast<int>(bands.size());
+	const int rows = grid.hQuads - 1;
+	for(int b = 0; b < n; b++)
+		classifyCells(grid, values.data(), states.data(), rows * b / n, rows * (b + 1) / n, bands[b]);
+	out.resize(out.capacity() > 1024 ? out.capacity() : 1024);
+	for(;;){
+		vertex_writer_t writer = makeWriter(out.data(), out.size());
+		emitCellsFilled(grid, states.data(), writer, fill);
+		growBuffer(out, writer.count);
+		if(!writer.overflowed())
+			return;
+	}
+}
+
+// Inside area of the grid in eighths of a cell, measured from the reference
+// segments rather than from any case table: each cell is clipped to the side
+// of every segment in it that holds an inside sample. Segment ends are
+// snapped to half cells, where the reference puts them, so the sum is exact.
+static int64_t insideEighths(const grid_t &grid, const std::vector<float> &values, const std::vector<oracle_segment_t> &refSegs){
+	const int w = grid.wQuads, cols = w - 1;
+	int64_t eighths = 0;
+	size_t s = 0;
+	std::vector<vec2f> poly, clipped;
+	for(int cell = 0; cell < cols * (grid.hQuads - 1); cell++){
+		const int j = cell % cols, i = cell / cols;
+		const vec2f corners[4] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+		const bool inside[4] = { values[i * w + j] >= 1, values[i * w + j + 1] >= 1,
+				values[(i + 1) * w + j + 1] >= 1, values[(i + 1) * w + j] >= 1 };
+		poly.assign(corners, corners + 4);
+		for(; s < refSegs.size() && refSegs[s].cell == cell; s++){
+			const oracle_segment_t &seg = refSegs[s];
+			const vec2f p = { std::round(2 * ((seg.x0 + 1) / grid.quadWidth - j)) / 2, std::round(2 * ((seg.y0 + 1) / grid.quadHeight - i)) / 2 };
+			const vec2f q = { std::round(2 * ((seg.x1 + 1) / grid.quadWidth - j)) / 2, std::round(2 * ((seg.y1 + 1) / grid.quadHeight - i)) / 2 };
+			auto side = [&](const vec2f &v){ return (q.x - p.x) * (v.y - p.y) - (q.y - p.y) * (v.x - p.x); };
+			// Segments run between edge midpoints, so no corner lies on one.
+			float keep = 0;
+			for(int c = 0; c < 4; c++)
+				if(inside[c] && std::fabs(side(corners[c])) > std::fabs(keep))
+					keep = side(corners[c]);
+			clipped.clear();
+			for(size_t k = 0; k < poly.size(); k++){
+				const vec2f &u = poly[k], &v = poly[(k + 1) % poly.size()];
+				const float su = side(u) * keep, sv = side(v) * keep;
+				if(su >= 0)
+					clipped.push_back(u);
+				if((su > 0 && sv < 0) || (su < 0 && sv > 0))
+					clipped.push_back({u.x + (v.x - u.x) * su / (su - sv), u.y + (v.y - u.y) * su / (su - sv)});
+			}
+			poly.swap(clipped);
+		}
+		if(poly.size() == 4 && !(inside[0] || inside[1] || inside[2] || inside[3]))
+			continue;
+		double area2 = 0.0;
+		for(size_t k = 0; k < poly.size(); k++){
+			const vec2f &u = poly[k], &v = poly[(k + 1) % poly.size()];
+			area2 += double(u.x) * v.y - double(v.x) * u.y;
+		}
+		eighths += std::llround(area2 * 4);
+	}
+	return eighths;
+}
+
+// Checks that no two fill vertices coincide, that every triangle is
+// counter-clockwise and not degenerate, that they meet edge to edge, and that
+// together they cover exactly the inside parts of the cells. Returns an empty
+// string if so.
+static std::string checkFill(const grid_t &grid, const std::vector<float> &values, const std::vector<oracle_segment_t> &refSegs,
+		const fill_mesh_t &fill){
+	std::vector<uint32_t> keys;
+	for(const vertex_t &v : fill.vertices)
+		keys.push_back(static_cast<uint32_t>(v.x) << 16 | v.y);
+	std::sort(keys.begin(), keys.end());
+	if(std::adjacent_find(keys.begin(), keys.end()) != keys.end())
+		return "duplicate fill vertex";
+	if(fill.indices.size() % 3 != 0)
+		return "index count not a multiple of 3";
+	int64_t area2 = 0;
+	for(size_t k = 0; k < fill.indices.size(); k += 3){
+		if(fill.indices[k] >= fill.vertices.size() || fill.indices[k + 1] >= fill.vertices.size() || fill.indices[k + 2] >= fill.vertices.size())
+			return "index out of range";
+		const vertex_t &a = fill.vertices[fill.indices[k]], &b = fill.vertices[fill.indices[k + 1]], &c = fill.vertices[fill.indices[k + 2]];
+		const int64_t cross = (int64_t(b.x) - a.x) * (int64_t(c.y) - a.y) - (int64_t(b.y) - a.y) * (int64_t(c.x) - a.x);
+		if(cross <= 0)
+			return "triangle " + std::to_string(k / 3) + " is clockwise or degenerate";
+		area2 += cross;
+	}
+	// A T-junction leaves an edge that nothing shares in the other direction.
+	// Only the contour segments, between two edge midpoints, and the grid
+	// border may be unshared.
+	std::vector<uint64_t> edges;
+	for(size_t k = 0; k < fill.indices.size(); k++){
+		const uint32_t a = fill.indices[k], b = fill.indices[k % 3 == 2 ? k - 2 : k + 1];
+		edges.push_back(static_cast<uint64_t>(a) << 32 | b);
+	}
+	std::sort(edges.begin(), edges.end());
+	const uint16_t cell = static_cast<uint16_t>((1 << grid.quantShift) - 1);
+	const uint16_t right = static_cast<uint16_t>((grid.wQuads - 1) << grid.quantShift);
+	const uint16_t top = static_cast<uint16_t>((grid.hQuads - 1) << grid.quantShift);
+	auto midpoint = [&](const vertex_t &v){ return ((v.x & cell) != 0) != ((v.y & cell) != 0); };
+	for(uint64_t e : edges){
+		if(std::binary_search(edges.begin(), edges.end(), e << 32 | e >> 32))
+			continue;
+		const vertex_t &a = fill.vertices[e >> 32], &b = fill.vertices[e & UINT32_MAX];
+		if(midpoint(a) && midpoint(b))
+			continue;
+		if((a.x == 0 && b.x == 0) || (a.x == right && b.x == right) || (a.y == 0 && b.y == 0) || (a.y == top && b.y == top))
+			continue;
+		return "edge (" + std::to_string(a.x) + ", " + std::to_string(a.y) + ") - (" + std::to_string(b.x) + ", " + std::to_string(b.y) + ") is not shared";
+	}
+	const int64_t eighths = insideEighths(grid, values, refSegs);
+	const int64_t full = int64_t(1) << grid.quantShift;
+	if(area2 * 4 != eighths * full * full)
+		return "fill area " + std::to_string(area2 / 2.0 / (full * full)) + " cells, expected " + std::to_string(eighths / 8.0);
+	return "";
+}
+
+// Checks stats against the contour measured directly: the area of the fill
+// triangles, the length of the reference segments and a flood fill of the
+// inside samples, 8-connected. Returns an empty string if they agree.
+static std::string checkStats(const grid_t &grid, const std::vector<float> &values, const fill_mesh_t &fill,
+		const std::vector<vec3f> &refVerts, const contour_stats_t &stats){
+	const double full = static_cast<double>(1 << grid.quantShift);
+	double area = 0.0;
+	for(size_t k = 0; k + 2 < fill.indices.size(); k += 3){
+		const vertex_t &a = fill.vertices[fill.indices[k]], &b = fill.vertices[fill.indices[k + 1]], &c = fill.vertices[fill.indices[k + 2]];
+		area += ((double(b.x) - a.x) * (double(c.y) - a.y) - (double(b.y) - a.y) * (double(c.x) - a.x)) / (2.0 * full * full);
+	}
+	if(std::fabs(area - stats.area) > 1e-6 * (1.0 + area))
+		return "area " + std::to_string(stats.area) + " cells, fill has " + std::to_string(area);
+
+	double length = 0.0;
+	for(size_t k = 0; k + 1 < refVerts.size(); k += 2)
+		length += std::hypot((refVerts[k + 1].x - refVerts[k].x) / grid.quadWidth, (refVerts[k + 1].y - refVerts[k].y) / grid.quadHeight);
+	if(std::fabs(length - stats.length) > 1e-3 * (1.0 + length))
+		return "length " + std::to_string(stats.length) + " cells, reference has " + std::to_string(length);
+
+	const int w = grid.wQuads, h = grid.hQuads;
+	std::vector<uint8_t> seen(static_cast<size_t>(w) * h, 0);
+	std::vector<int> stack;
+	int components = 0;
+	for(int start = 0; start < w * h; start++){
+		if(seen[start] || values[start] < 1)
+			continue;
+		components++;
+		seen[start] = 1;
+		stack.push_back(start);
+		while(!stack.empty()){
+			const int p = stack.back();
+			stack.pop_back();
+			for(int dy = -1; dy <= 1; dy++)
+				for(int dx = -1; dx <= 1; dx++){
+					const int x = p % w + dx, y = p / w + dy;
+					if(x < 0 || x >= w || y < 0 || y >= h || seen[y * w + x] || values[y * w + x] < 1)
+						continue;
+					seen[y * w + x] = 1;
+					stack.push_back(y * w + x);
+				}
+		}
+	}
+	if(components != stats.components)
+		return std::to_string(stats.components) + " components, flood fill finds " + std::to_string(components);
+	return "";
+}
+
+// Checks an engine across frames rather than independent scenes: each
+// sequence keeps one grid and moves its spheres with stepSpheres, now and
+// then spawning or removing one, so engines that carry state between frames
+// take their coherent paths. Every frame is compared against reference.
+static int runMotion(ContourEngine* engine, int sequences, unsigned int seed, float tolerance){
+	const int FRAMES = 60;
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> velDist(-0.01f, 0.01f);
+	std::uniform_real_distribution<float> radDist(0.01f, 0.3f);
+	std::uniform_real_distribution<float> posDist(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> eventDist(0, 19);
+	std::uniform_int_distribution<int> stepDist(1, 3);
+	grid_t grid;
+	std::vector<sphere_t> spheres;
+	std::vector<vec3f> refVerts, gotVerts;
+	std::vector<vertex_t> gotQuant;
+	std::vector<oracle_segment_t> refSegs, gotSegs;
+	size_t segments = 0;
+	const unsigned long coherentBefore = engine->getCoherentFrames();
+
+	auto start = std::chrono::steady_clock::now();
+	for(int n = 0; n < sequences; n++) {
+		randomScene(rng, grid, spheres);
+		for(sphere_t &s : spheres)
+			s.vel = {velDist(rng), velDist(rng)};
+		for(int f = 0; f < FRAMES; f++) {
+			const int steps = stepDist(rng);
+			for(int k = 0; k < steps; k++)
+				stepSpheres(spheres, 1.0);
+			const int event = eventDist(rng);
+			if(event == 0)
+				spheres.push_back({{posDist(rng), posDist(rng)}, {velDist(rng), velDist(rng)}, radDist(rng)});
+			else if(event == 1 && spheres.size() > 1)
+				spheres.erase(spheres.begin() + std::uniform_int_distribution<size_t>(0, spheres.size() - 1)(rng));
+
+			const MetaballField field(spheres);
+			extractReference(grid, field, refVerts);
+			extractToVector(engine, grid, field, gotQuant);
+			gotVerts.clear();
+			for(const vertex_t &v : gotQuant)
+				gotVerts.push_back(dequantize(grid, v));
+			normalize(grid, refVerts, refSegs);
+			normalize(grid, gotVerts, gotSegs);
+			segments += refSegs.size();
+			if(gotVerts.size() % 2 != 0 || compareScene(grid, refSegs, gotSegs, tolerance, false) >= 0) {
+				fprintf(stderr, "MISMATCH: sequence %d frame %d (seed %u): %dx%d samples, %zu spheres, reference %zu segments, %s %zu segments\n",
+						n, f, seed, grid.wQuads, grid.hQuads, spheres.size(), refSegs.size(), engine->name(), gotSegs.size());
+				compareScene(grid, refSegs, gotSegs, tolerance, true);
+				return 1;
+			}
+		}
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const unsigned long coherent = engine->getCoherentFrames() - coherentBefore;
+	const unsigned long frames = static_cast<unsigned long>(sequences) * FRAMES;
+	if(strcmp(engine->name(), "temporal") == 0 && sequences > 0 && coherent == 0) {
+		fprintf(stderr, "MISMATCH: no frame of %lu took the temporal engine's search from the previous frame\n", frames);
+		return 1;
+	}
+	printf("OK: %s matches reference on %d sequences of %d frames (%zu segments) in %.2fs\n",
+			engine->name(), sequences, FRAMES, segments, secs);
+	if(coherent > 0)
+		printf("  %lu of %lu frames started from the previous frame's contour\n", coherent, frames);
+	return 0;
+}
+
+// Keeps a streamed contour.
+class CollectingSink : public SegmentSink {
+	public:
+		explicit CollectingSink(std::vector<segment_t> &out) : out(out) {}
+
+		bool write(const segment_t *segments, size_t count){
+			out.insert(out.end(), segments, segments + count);
+			return true;
+		}
+
+	private:
+		std::vector<segment_t> &out;
+};
+
+// Streams random rasters through a tiled container at random isovalues and
+// checks them against reference on the same samples. Every other raster has
+// two levels, 0 and the float just below the isovalue, which the isovalue
+// shift may round onto the isoline; a run whose tiles bound it below must
+// then still be read.
+static int runStreamOracle(int scenes, unsigned int seed, float tolerance){
+	char dir[] = "/tmp/msq-oracle-XXXXXX";
+	if(!mkdtemp(dir)){
+		fprintf(stderr, "ERROR: cannot create a temporary directory for the rasters\n");
+		return -1;
+	}
+	const std::string rawPath = std::string(dir) + "/raster.msqr";
+	const std::string tiledPath = std::string(dir) + "/raster.msqt";
+	const int codec = parseTileCodec("lz4") >= 0 ? TILE_CODEC_LZ4 : TILE_CODEC_NONE;
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> isoDist(0.3f, 3.0f);
+	std::uniform_int_distribution<int> tileDist(4, 6);
+	grid_t grid;
+	std::vector<sphere_t> spheres;
+	std::vector<float> values;
+	std::vector<uint8_t> file;
+	std::vector<segment_t> streamed;
+	std::vector<vec3f> refVerts, gotVerts;
+	std::vector<oracle_segment_t> refSegs, gotSegs;
+	uint64_t samples = 0, skipped = 0;
+	size_t segments = 0;
+	int failed = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for(int n = 0; n < scenes && !failed; n++){
+		randomScene(rng, grid, spheres);
+		const int w = grid.wQuads, h = grid.hQuads;
+		const float isovalue = isoDist(rng);
+		const float upper = std::nextafter(isovalue, 0.0f);
+		const MetaballField metaballs(spheres);
+		values.resize(static_cast<size_t>(w) * h);
+		for(int i = 0; i < h; i++)
+			metaballs.evaluate(grid, i, 0, 1, w, values.data() + static_cast<size_t>(i) * w);
+		if(n % 2 == 1){
+			for(float &v : values)
+				v = v >= isovalue ? upper : 0.0f;
+		}
+
+		// A raw float32 raster, rows top first, tiled as --tile would.
+		file.assign(RASTER_HEADER_BYTES + values.size() * sizeof(float), 0);
+		memcpy(file.data(), "MSQR", 4);
+		writeLE32(file.data() + 4, RASTER_FLOAT32);
+		writeLE32(file.data() + 8, w);
+		writeLE32(file.data() + 12, h);
+		writeLE32f(file.data() + 16, 1.0f);
+		writeLE32f(file.data() + 20, 0.0f);
+		for(int i = 0; i < h; i++)
+			for(int j = 0; j < w; j++)
+				writeLE32f(file.data() + RASTER_HEADER_BYTES + (static_cast<size_t>(h - 1 - i) * w + j) * sizeof(float), values[static_cast<size_t>(i) * w + j]);
+		FILE* out = fopen(rawPath.c_str(), "wb");
+		bool ok = out && fwrite(file.data(), 1, file.size(), out) == file.size();
+		ok = out && fclose(out) == 0 && ok;
+		Raster* raw = ok ? openRaster(rawPath.c_str()) : nullptr;
+		ok = raw && writeTiled(*raw, tiledPath.c_str(), 1 << tileDist(rng), codec) > 0;
+		delete raw;
+		Raster* tiled = ok ? openRaster(tiledPath.c_str()) : nullptr;
+		if(!tiled){
+			fprintf(stderr, "ERROR: cannot write the raster of scene %d to %s\n", n, dir);
+			failed = -1;
+			break;
+		}
+
+		// A tight budget, so the raster is streamed in several bands.
+		streamed.clear();
+		CollectingSink sink(streamed);
+		stream_stats_t stats;
+		const int status = streamContour(*tiled, isovalue, 4 * minStreamMemory(*tiled), sink, stats);
+		delete tiled;
+		if(status != 0){
+			failed = 1;
+			break;
+		}
+		samples += values.size();
+		skipped += stats.skipped;
+
+		const RasterField<float> field(values.data(), w, h, w);
+		extractReference(grid, IsovalueField(field, isovalue), refVerts);
+		gotVerts.clear();
+		for(const segment_t &g : streamed){
+			gotVerts.push_back({g.x0 * grid.quadWidth - 1.0f, g.y0 * grid.quadHeight - 1.0f, 0.0f});
+			gotVerts.push_back({g.x1 * grid.quadWidth - 1.0f, g.y1 * grid.quadHeight - 1.0f, 0.0f});
+		}
+		normalize(grid, refVerts, refSegs);
+		normalize(grid, gotVerts, gotSegs);
+		segments += refSegs.size();
+		if(compareScene(grid, refSegs, gotSegs, tolerance, false) >= 0){
+			fprintf(stderr, "MISMATCH: scene %d (seed %u): %dx%d samples, %s, isovalue %g, reference %zu segments, stream %zu segments\n",
+					n, seed, w, h, n % 2 == 1 ? "two levels" : (std::to_string(spheres.size()) + " spheres").c_str(),
+					isovalue, refSegs.size(), gotSegs.size());
+			compareScene(grid, refSegs, gotSegs, tolerance, true);
+			failed = 1;
+		}
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	unlink(rawPath.c_str());
+	unlink(tiledPath.c_str());
+	rmdir(dir);
+
+	if(!failed){
+		printf("OK: stream matches reference on %d tiled rasters (%zu segments) in %.2fs\n", scenes, segments, secs);
+		printf("  %.1f%% of samples skipped by bounds\n", samples > 0 ? 100.0 * skipped / samples : 0.0);
+	}
+	return failed;
+}
+
+int runOracle(const char* engineName, int scenes, unsigned int seed, float tolerance){
+	// "stream" checks --stream over tiled containers instead.
+	if(strcmp(engineName, "stream") == 0)
+		return runStreamOracle(scenes, seed, tolerance);
+
+	// "motion:<engine>" runs the engine over moving sequences instead.
+	if(strncmp(engineName, "motion:", 7) == 0) {
+		ContourEngine* engine = createEngine(engineName + 7);
+		if(!engine) {
+			fprintf(stderr, "ERROR: unknown contour engine '%s'\n", engineName + 7);
+			return -1;
+		}
+		const int failed = runMotion(engine, scenes, seed, tolerance);
+		delete engine;
+		return failed;
+	}
+
+	// "span" checks SpanIndex instead, at a few random isovalues per scene;
+	// "archive" checks scanline's output after a round trip through the
+	// contour archive codec; "fill" the staged kernels' lines and fill mesh,
+	// and "stats" those again plus the statistics of a random band split.
+	const bool span = strcmp(engineName, "span") == 0;
+	const bool archive = strcmp(engineName, "archive") == 0;
+	const bool counted = strcmp(engineName, "stats") == 0;
+	const bool filled = counted || strcmp(engineName, "fill") == 0;
+	ContourEngine* engine = span || filled ? nullptr : createEngine(archive ? "scanline" : engineName);
+	if(!span && !filled && !engine) {
+		fprintf(stderr, "ERROR: unknown contour engine '%s'\n", engineName);
+		return -1;
+	}
+	const char* name = span ? "span" : archive ? "archive" : counted ? "stats" : filled ? "fill" : engine->name();
+
+	std::mt19937 rng(seed);
+	grid_t grid;
+	std::vector<sphere_t> spheres;
+	std::vector<vec3f> refVerts, gotVerts;
+	std::vector<vertex_t> gotQuant;
+	std::vector<oracle_segment_t> refSegs, gotSegs;
+	SpanIndex index;
+	ContourCodec codec;
+	std::vector<uint8_t> payload;
+	std::vector<vertex_t> decoded;
+	std::vector<float> values;
+	std::vector<uint8_t> states;
+	fill_mesh_t fill;
+	std::vector<stats_band_t> bands(1);
+	int maxComponents = 0;
+	size_t triangles = 0;
+	size_t stored = 0;
+	double encodeSecs = 0.0, decodeSecs = 0.0;
+	size_t segments = 0;
+	int failed = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for(int n = 0; n < scenes && !failed; n++) {
+		randomScene(rng, grid, spheres);
+		// Every eighth scene is noise, a field with no bounds or interior
+		// points, so the engines' generic fallbacks are covered too.
+		const bool noisy = n % 8 == 7;
+		MetaballField metaballs(spheres);
+		NoiseField noise(rng(), noisy ? std::uniform_real_distribution<float>(1.0f, 8.0f)(rng) : 1.0f, 3);
+		const ScalarField &field = noisy ? static_cast<const ScalarField&>(noise) : metaballs;
+		if(span)
+			index.build(grid, field);
+		const int queries = span ? 3 : 1;
+		for(int q = 0; q < queries; q++) {
+			const float isovalue = span ? std::uniform_real_distribution<float>(noisy ? 0.6f : 0.3f, noisy ? 1.4f : 3.0f)(rng) : 1.0f;
+			extractReference(grid, IsovalueField(field, isovalue), refVerts);
+			if(span)
+				queryToVector(index, isovalue, gotQuant);
+			else if(filled) {
+				if(counted)
+					bands.resize(std::uniform_int_distribution<int>(1, 8)(rng));
+				fillToVector(grid, field, values, states, bands, fill, gotQuant);
+				normalize(grid, refVerts, refSegs);
+				std::string why = checkFill(grid, values, refSegs, fill);
+				if(why.empty() && counted) {
+					const contour_stats_t stats = reduceStats(bands.data(), static_cast<int>(bands.size()));
+					why = checkStats(grid, values, fill, refVerts, stats);
+					maxComponents = std::max(maxComponents, stats.components);
+				}
+				if(!why.empty()) {
+					fprintf(stderr, "MISMATCH: scene %d (seed %u): %dx%d samples: %s\n", n, seed, grid.wQuads, grid.hQuads, why.c_str());
+					failed = 1;
+					break;
+				}
+				triangles += fill.indices.size() / 3;
+			} else
+				extractToVector(engine, grid, field, gotQuant);
+			if(archive) {
+				auto t0 = std::chrono::steady_clock::now();
+				payload.clear();
+				const int unitShift = codec.encode(gotQuant.data(), gotQuant.size(), payload);
+				auto t1 = std::chrono::steady_clock::now();
+				if(!codec.decode(payload.data(), payload.size(), unitShift, gotQuant.size() / 2, decoded)) {
+					fprintf(stderr, "MISMATCH: scene %d (seed %u): archive payload of %zu segments does not decode\n", n, seed, gotQuant.size() / 2);
+					failed = 1;
+					break;
+				}
+				auto t2 = std::chrono::steady_clock::now();
+				encodeSecs += std::chrono::duration<double>(t1 - t0).count();
+				decodeSecs += std::chrono::duration<double>(t2 - t1).count();
+				stored += payload.size();
+				gotQuant.swap(decoded);
+			}
+			gotVerts.clear();
+			for(const vertex_t &v : gotQuant)
+				gotVerts.push_back(dequantize(grid, v));
+			if(gotVerts.size() % 2 != 0) {
+				fprintf(stderr, "MISMATCH: scene %d (seed %u): %s emitted an odd vertex count (%zu)\n", n, seed, name, gotVerts.size());
+				failed = 1;
+				break;
+			}
+			normalize(grid, refVerts, refSegs);
+			normalize(grid, gotVerts, gotSegs);
+			segments += refSegs.size();
+			if(compareScene(grid, refSegs, gotSegs, tolerance, false) >= 0) {
+				fprintf(stderr, "MISMATCH: scene %d (seed %u): %dx%d samples, %s, isovalue %g, reference %zu segments, %s %zu segments\n",
+						n, seed, grid.wQuads, grid.hQuads, noisy ? "noise" : (std::to_string(spheres.size()) + " spheres").c_str(),
+						isovalue, refSegs.size(), name, gotSegs.size());
+				compareScene(grid, refSegs, gotSegs, tolerance, true);
+				failed = 1;
+				break;
+			}
+		}
+	}
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if(!failed)
+		printf("OK: %s matches reference on %d scenes (%zu segments) in %.2fs, %.0f scenes/min\n",
+				name, scenes, segments, secs, secs > 0.0 ? scenes * 60.0 / secs : 0.0);
+	if(!failed && counted)
+		printf("  area, length and up to %d components agree with the fill, the reference and a flood fill\n", maxComponents);
+	if(!failed && filled)
+		printf("  %zu fill triangles, all counter-clockwise, covering exactly the inside cells\n", triangles);
+	if(!failed && archive && segments > 0)
+		printf("  %.2f bytes per segment, %.1fx smaller than vertex_t pairs, %.1fx than vec3f; encode %.0f, decode %.0f Msegments/s\n",
+				static_cast<double>(stored) / segments, 2.0 * sizeof(vertex_t) * segments / stored, 2.0 * sizeof(vec3f) * segments / stored,
+				encodeSecs > 0.0 ? segments / encodeSecs / 1e6 : 0.0, decodeSecs > 0.0 ? segments / decodeSecs / 1e6 : 0.0);
+	delete engine;
+	return failed ? 1 : 0;
+}
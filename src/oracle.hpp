@@ -0,0 +1,9 @@
+#ifndef __ORACLE_HPP__
+#define __ORACLE_HPP__
+
+// Runs extractReference and the named engine on randomized scenes and compares
+// the resulting segment sets cell by cell. Prints the first mismatching cell of
+// the first failing scene and returns 0 only if every scene matched.
+int runOracle(const char* engineName, int scenes, unsigned int seed, float tolerance);
+
+#endif
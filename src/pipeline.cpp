@@ -0,0 +1,148 @@
+#include "pipeline.hpp"
+#include "simulation.hpp"
+#include "field.hpp"
+
+static const char* const s_stageNames[STAGE_COUNT] = { "simulate", "evaluate", "classify", "emit", "upload" };
+
+FramePipeline::FramePipeline(int depth, int workers, const std::vector<sphere_t> &spheres, int width, int height, int res, float isovalue, upload_fn upload)
+	: depth(depth), bands(workers > 0 ? workers : 1), width(width), height(height), res(res), isovalue(isovalue), upload(upload),
+	slots(depth), head(0), inFlight(0), spheres(spheres), lastTime(clock::now()), dt(0.0), dropped(0),
+	graph(workers, STAGE_COUNT), windowStart(clock::now()), frames(0), bubbles(0), blocked(0.0), latency(0.0), lastExtract(0.0), lastStats() {
+	for(slot_t &slot : slots)
+		slot.metaballs = std::vector<MetaballField>(bands, MetaballField(slot.spheres));
+}
+
+FramePipeline::~FramePipeline(){
+	while(inFlight > 0){
+		graph.wait(slots[head].upload);
+		slots[head].upload.reset();
+		head = (head + 1) % depth;
+		inFlight--;
+	}
+}
+
+void FramePipeline::simulate(slot_t &slot){
+	clock::time_point nowTime = clock::now();
+	dt += std::chrono::duration<double>(nowTime - lastTime).count() / (1.0/60.0);
+	lastTime = nowTime;
+	int skipped = 0;
+	slot.steps = advanceSimulation(spheres, dt, skipped);
+	dropped += skipped;
+	slot.spheres = spheres;
+	slot.grid = makeGrid(width, height, res);
+	slot.isovalue = isovalue;
+	growBuffer(slot.field, static_cast<size_t>(slot.grid.wQuads) * slot.grid.hQuads);
+	growBuffer(slot.states, static_cast<size_t>(slot.grid.wQuads - 1) * (slot.grid.hQuads - 1));
+	slot.bands.resize(bands);
+	slot.simulated = clock::now();
+}
+
+void FramePipeline::submit(){
+	slot_t &slot = slots[(head + inFlight) % depth];
+	slot.submitted = clock::now();
+	slot_t *s = &slot;
+	const int n = bands;
+
+	JobGraph::node_handle sim = graph.add(STAGE_SIMULATE, 1, false, [this, s](int){
+		simulate(*s);
+	}, {lastSimulate});
+	JobGraph::node_handle evaluate = graph.add(STAGE_EVALUATE, n, false, [s, n](int band){
+		const int rows = s->grid.hQuads;
+		evaluateField(s->grid, IsovalueField(s->metaballs[band], s->isovalue), s->field.data(), rows * band / n, rows * (band + 1) / n);
+	}, {sim});
+	JobGraph::node_handle classify = graph.add(STAGE_CLASSIFY, n, false, [s, n](int band){
+		const int rows = s->grid.hQuads - 1;
+		classifyCells(s->grid, s->field.data(), s->states.data(), rows * band / n, rows * (band + 1) / n, s->bands[band]);
+	}, {evaluate});
+	JobGraph::node_handle emit = graph.add(STAGE_EMIT, 1, false, [s, n](int){
+		s->stats = reduceStats(s->bands.data(), n);
+		s->verts.resize(s->verts.capacity() > 1024 ? s->verts.capacity() : 1024);
+		for(;;){
+			vertex_writer_t writer = makeWriter(s->verts.data(), s->verts.size());
+			emitCells(s->grid, s->states.data(), writer);
+			growBuffer(s->verts, writer.count);
+			if(!writer.overflowed())
+				break;
+		}
+		s->extractTime = std::chrono::duration<double>(clock::now() - s->simulated).count();
+	}, {classify});
+	// After the previous frame's upload too: wait() runs whichever upload is
+	// ready first, and a newer contour must never be overwritten by an older one.
+	slot.upload = graph.add(STAGE_UPLOAD, 1, true, [this, s](int){
+		upload(s->grid, s->verts);
+	}, {emit, lastUpload});
+
+	lastSimulate = sim;
+	lastUpload = slot.upload;
+	inFlight++;
+}
+
+int FramePipeline::advance(){
+	while(inFlight < depth)
+		submit();
+
+	slot_t &slot = slots[head];
+	double waited = graph.wait(slot.upload);
+	if(waited > 0.0){
+		bubbles++;
+		blocked += waited;
+	}
+	latency += std::chrono::duration<double>(clock::now() - slot.submitted).count();
+	lastExtract = slot.extractTime;
+	lastStats = slot.stats;
+	slot.upload.reset();
+	head = (head + 1) % depth;
+	inFlight--;
+	frames++;
+	return slot.steps;
+}
+
+int FramePipeline::takeDropped(){
+	return dropped.exchange(0);
+}
+
+double FramePipeline::getExtractTime() const {
+	return lastExtract;
+}
+
+contour_stats_t FramePipeline::getStats() const {
+	return lastStats;
+}
+
+void FramePipeline::setResolution(int res){
+	this->res = res;
+}
+
+void FramePipeline::setSize(int width, int height){
+	this->width = width;
+	this->height = height;
+}
+
+void FramePipeline::setIsovalue(float isovalue){
+	this->isovalue = isovalue;
+}
+
+void FramePipeline::report(FILE* out){
+	if(frames == 0)
+		return;
+	std::vector<double> busy;
+	graph.takeBusy(busy);
+	const double wall = std::chrono::duration<double>(clock::now() - windowStart).count();
+	const int workers = graph.getWorkers();
+
+	double workerBusy = 0.0;
+	fprintf(out, "  pipeline depth %d, %d workers:", depth, workers);
+	for(int st = 0; st < STAGE_COUNT; st++){
+		// Upload runs on the render thread, everything else on the workers.
+		const int threads = st == STAGE_UPLOAD ? 1 : workers;
+		fprintf(out, " %s %.3f ms %.0f%%", s_stageNames[st], busy[st] * 1000.0 / frames, 100.0 * busy[st] / (wall * threads));
+		if(st != STAGE_UPLOAD)
+			workerBusy += busy[st];
+	}
+	fprintf(out, "\n  pipeline bubbles: %d/%d frames, %.3f ms/frame stalled, workers %.0f%% busy, latency %.3f ms\n",
+			bubbles, frames, blocked * 1000.0 / frames, workers ? 100.0 * workerBusy / (wall * workers) : 0.0, latency * 1000.0 / frames);
+
+	windowStart = clock::now();
+	frames = bubbles = 0;
+	blocked = latency = 0.0;
+}
@@ -0,0 +1,109 @@
+#ifndef __PIPELINE_HPP__
+#define __PIPELINE_HPP__
+
+#include "contour.hpp"
+#include "field.hpp"
+#include "job_graph.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+enum pipeline_stage_t {
+	STAGE_SIMULATE,
+	STAGE_EVALUATE,
+	STAGE_CLASSIFY,
+	STAGE_EMIT,
+	STAGE_UPLOAD,
+	STAGE_COUNT
+};
+
+// Frame pipeline with up to `depth` frames in flight. Each frame is a chain
+// of JobGraph nodes simulate -> evaluate -> classify -> emit -> upload, where
+// simulate and upload also wait for the previous frame's, and evaluate/classify
+// are split into row bands across the workers. Upload runs on the render
+// thread, so with depth > 1 frame N+1 is contoured while frame N is uploaded
+// and drawn, at the cost of depth - 1 frames of latency.
+class FramePipeline {
+	public:
+		typedef std::function<void(const grid_t &grid, const std::vector<vertex_t> &verts)> upload_fn;
+
+		FramePipeline(int depth, int workers, const std::vector<sphere_t> &spheres, int width, int height, int res, float isovalue, upload_fn upload);
+		~FramePipeline();
+
+		// Render thread, once per frame: tops the pipeline up to depth frames,
+		// then runs the upload of the oldest one. Returns its physics step count.
+		int advance();
+		// Physics steps dropped by the catch-up cap since the last call.
+		int takeDropped();
+		// Extraction time (evaluate to emit, wall clock) of the frame last returned by advance().
+		double getExtractTime() const;
+		// Contour statistics of that frame, gathered by the classify bands.
+		contour_stats_t getStats() const;
+		// Grid resolution for frames submitted from now on.
+		void setResolution(int res);
+		// Framebuffer size for frames submitted from now on.
+		void setSize(int width, int height);
+		// Isovalue for frames submitted from now on.
+		void setIsovalue(float isovalue);
+		// Per-frame stage times, utilization and bubbles since the last report.
+		void report(FILE* out);
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		struct slot_t {
+			std::vector<sphere_t> spheres;
+			// One per evaluate band, since the bands run on different workers.
+			std::vector<MetaballField> metaballs;
+			grid_t grid;
+			float isovalue;
+			std::vector<float> field;
+			std::vector<uint8_t> states;
+			std::vector<stats_band_t> bands;
+			contour_stats_t stats;
+			std::vector<vertex_t> verts;
+			int steps;
+			clock::time_point submitted;
+			clock::time_point simulated;
+			double extractTime;
+			JobGraph::node_handle upload;
+		};
+
+		void submit();
+		void simulate(slot_t &slot);
+
+		int depth;
+		int bands;
+		// Read by the simulate nodes. A frame that sees a new width with the
+		// old height is still a valid grid, so they are set independently.
+		std::atomic<int> width, height;
+		std::atomic<int> res;
+		std::atomic<float> isovalue;
+		upload_fn upload;
+		std::vector<slot_t> slots;
+		int head;
+		int inFlight;
+		// Uploads are chained in frame order like the simulate nodes.
+		JobGraph::node_handle lastUpload;
+
+		// Owned by the simulate nodes, which are serialized by their dependency chain.
+		std::vector<sphere_t> spheres;
+		clock::time_point lastTime;
+		double dt;
+		std::atomic<int> dropped;
+		JobGraph::node_handle lastSimulate;
+
+		JobGraph graph;
+		clock::time_point windowStart;
+		int frames;
+		int bubbles;
+		double blocked;
+		double latency;
+		double lastExtract;
+		contour_stats_t lastStats;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "profiler.hpp"
+
+static const char* const s_zoneNames[ZONE_COUNT] = { "simulate", "extract", "upload", "draw", "swap" };
+static const bool s_gpuZone[ZONE_COUNT] = { false, false, true, true, true };
+
+Profiler::Profiler()
+	: gpu(false), warmup(true), slot(0), frameOpen(false), gpuFrameTotal(0.0), gpuFrames(0), gpuDropped(0), frames(0) {
+	for(int i = 0; i < LATENCY; i++){
+		issued[i] = false;
+		for(int z = 0; z < ZONE_COUNT; z++)
+			zoneIssued[i][z] = false;
+	}
+	for(int z = 0; z < ZONE_COUNT; z++)
+		cpuTotal[z] = gpuTotal[z] = 0.0;
+}
+
+Profiler::~Profiler(){
+	if(gpu){
+		glDeleteQueries(LATENCY, frameQuery);
+		glDeleteQueries(LATENCY * ZONE_COUNT * 2, &zoneQuery[0][0][0]);
+	}
+}
+
+void Profiler::initGPU(){
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	if(bits == 0)
+		return;
+	glGenQueries(LATENCY, frameQuery);
+	glGenQueries(LATENCY * ZONE_COUNT * 2, &zoneQuery[0][0][0]);
+	gpu = true;
+}
+
+bool Profiler::hasGPU() const {
+	return gpu;
+}
+
+void Profiler::beginFrame(){
+	frameOpen = true;
+	if(!gpu)
+		return;
+	glBeginQuery(GL_TIME_ELAPSED, frameQuery[slot]);
+	for(int z = 0; z < ZONE_COUNT; z++)
+		zoneIssued[slot][z] = false;
+}
+
+void Profiler::endFrame(){
+	frames++;
+	frameOpen = false;
+	if(!gpu)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	issued[slot] = true;
+	slot = (slot + 1) % LATENCY;
+	// The slot about to be reused was issued LATENCY frames ago.
+	if(issued[slot])
+		collect(slot);
+}
+
+void Profiler::collect(int s){
+	GLint available = 0;
+	glGetQueryObjectiv(frameQuery[s], GL_QUERY_RESULT_AVAILABLE, &available);
+	for(int z = 0; available && z < ZONE_COUNT; z++){
+		if(zoneIssued[s][z])
+			glGetQueryObjectiv(zoneQuery[s][z][1], GL_QUERY_RESULT_AVAILABLE, &available);
+	}
+	issued[s] = false;
+	// The first frame's queries are begun on a context that has not rendered
+	// yet; llvmpipe returns a raw timestamp instead of an interval for it.
+	if(warmup){
+		warmup = false;
+		return;
+	}
+	if(!available){
+		gpuDropped++;
+		return;
+	}
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(frameQuery[s], GL_QUERY_RESULT, &elapsed);
+	gpuFrameTotal += elapsed * 1e-9;
+	for(int z = 0; z < ZONE_COUNT; z++){
+		if(!zoneIssued[s][z])
+			continue;
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(zoneQuery[s][z][0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(zoneQuery[s][z][1], GL_QUERY_RESULT, &end);
+		if(end > begin)
+			gpuTotal[z] += (end - begin) * 1e-9;
+	}
+	gpuFrames++;
+}
+
+void Profiler::beginZone(zone_t zone){
+	zoneStart[zone] = clock::now();
+	if(gpu && frameOpen && s_gpuZone[zone] && !zoneIssued[slot][zone])
+		glQueryCounter(zoneQuery[slot][zone][0], GL_TIMESTAMP);
+}
+
+void Profiler::endZone(zone_t zone){
+	cpuTotal[zone] += std::chrono::duration<double>(clock::now() - zoneStart[zone]).count();
+	if(gpu && frameOpen && s_gpuZone[zone]){
+		glQueryCounter(zoneQuery[slot][zone][1], GL_TIMESTAMP);
+		zoneIssued[slot][zone] = true;
+	}
+}
+
+void Profiler::addTime(zone_t zone, double seconds){
+	cpuTotal[zone] += seconds;
+}
+
+void Profiler::report(FILE* out){
+	if(frames == 0)
+		return;
+	fprintf(out, "  cpu ms/frame:");
+	for(int z = 0; z < ZONE_COUNT; z++)
+		fprintf(out, " %s %.3f", s_zoneNames[z], cpuTotal[z] * 1000.0 / frames);
+	fprintf(out, "\n");
+	if(gpu && gpuFrames > 0){
+		fprintf(out, "  gpu ms/frame:");
+		for(int z = 0; z < ZONE_COUNT; z++){
+			if(s_gpuZone[z])
+				fprintf(out, " %s %.3f", s_zoneNames[z], gpuTotal[z] * 1000.0 / gpuFrames);
+		}
+		fprintf(out, " frame %.3f (%d frames sampled, %d not ready)\n", gpuFrameTotal * 1000.0 / gpuFrames, gpuFrames, gpuDropped);
+	}
+
+	frames = gpuFrames = gpuDropped = 0;
+	gpuFrameTotal = 0.0;
+	for(int z = 0; z < ZONE_COUNT; z++)
+		cpuTotal[z] = gpuTotal[z] = 0.0;
+}
@@ -0,0 +1,68 @@
+#ifndef __PROFILER_HPP__
+#define __PROFILER_HPP__
+
+#include "glad/glad.h"
+
+#include <chrono>
+#include <cstdio>
+
+enum zone_t {
+	ZONE_SIMULATE,
+	ZONE_EXTRACT,
+	ZONE_UPLOAD,
+	ZONE_DRAW,
+	ZONE_SWAP,
+	ZONE_COUNT
+};
+
+// Per-frame CPU zone timers plus GPU timestamps for the zones that submit GL
+// work (upload, draw, swap) and a GL_TIME_ELAPSED query around the whole
+// frame. GPU queries live in a ring LATENCY frames deep and are only read once
+// GL_QUERY_RESULT_AVAILABLE says so, so reading them never stalls the pipeline.
+class Profiler {
+	public:
+		static const int LATENCY = 4;
+
+		Profiler();
+		~Profiler();
+
+		// Needs a current context; leaves GPU timing off if the driver has no timer queries.
+		void initGPU();
+
+		void beginFrame();
+		void endFrame();
+		// A zone may be entered several times per frame; CPU time adds up and
+		// the GPU range spans from its first begin to its last end.
+		void beginZone(zone_t zone);
+		void endZone(zone_t zone);
+		// CPU time measured elsewhere, e.g. on the simulation thread.
+		void addTime(zone_t zone, double seconds);
+
+		// Per-frame averages since the last report, then starts a new window.
+		void report(FILE* out);
+		bool hasGPU() const;
+
+	private:
+		typedef std::chrono::steady_clock clock;
+
+		bool gpu;
+		bool warmup;
+		int slot;
+		bool frameOpen;
+		GLuint frameQuery[LATENCY];
+		GLuint zoneQuery[LATENCY][ZONE_COUNT][2];
+		bool issued[LATENCY];
+		bool zoneIssued[LATENCY][ZONE_COUNT];
+
+		clock::time_point zoneStart[ZONE_COUNT];
+		double cpuTotal[ZONE_COUNT];
+		double gpuTotal[ZONE_COUNT];
+		double gpuFrameTotal;
+		int gpuFrames;
+		int gpuDropped;
+		int frames;
+
+		void collect(int slot);
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "raster.hpp"
+#include "tiled.hpp"
+
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Other sample encodings of the formats below, see le32f_t.
+struct le16_t {
+	uint8_t b[2];
+	operator float() const { return static_cast<float>(b[0] | b[1] << 8); }
+};
+
+struct be16_t {
+	uint8_t b[2];
+	operator float() const { return static_cast<float>(b[0] << 8 | b[1]); }
+};
+
+struct be32f_t {
+	uint8_t b[4];
+	operator float() const {
+		uint32_t u = static_cast<uint32_t>(b[0]) << 24 | static_cast<uint32_t>(b[1]) << 16 | static_cast<uint32_t>(b[2]) << 8 | static_cast<uint32_t>(b[3]);
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+};
+
+// Next whitespace separated token of a PNM header, skipping '#' comments.
+// Leaves pos on the character after it.
+static bool readToken(const uint8_t* data, size_t length, size_t &pos, char* out, size_t outSize){
+	for(;;){
+		while(pos < length && isspace(data[pos]))
+			pos++;
+		if(pos < length && data[pos] == '#'){
+			while(pos < length && data[pos] != '\n')
+				pos++;
+			continue;
+		}
+		break;
+	}
+	size_t n = 0;
+	while(pos < length && !isspace(data[pos]) && n + 1 < outSize)
+		out[n++] = data[pos++];
+	out[n] = '\0';
+	return n > 0 && (pos == length || isspace(data[pos]));
+}
+
+static bool readDimension(const uint8_t* data, size_t length, size_t &pos, int &value){
+	char token[32];
+	if(!readToken(data, length, pos, token, sizeof(token)))
+		return false;
+	char* end;
+	long v = strtol(token, &end, 10);
+	if(*end != '\0' || v <= 0 || v > INT_MAX)
+		return false;
+	value = static_cast<int>(v);
+	return true;
+}
+
+// Rows stored top first start at the last row and walk backwards.
+template <typename T>
+static ScalarField* makeField(const uint8_t* samples, int width, int height, bool topFirst, float scale, float offset){
+	const T* data = reinterpret_cast<const T*>(samples);
+	if(topFirst)
+		return new RasterField<T>(data + static_cast<ptrdiff_t>(height - 1) * width, width, height, -static_cast<ptrdiff_t>(width), scale, offset);
+	return new RasterField<T>(data, width, height, width, scale, offset);
+}
+
+Raster::Raster() : map(MAP_FAILED), length(0), dataOffset(0), sampleBytes(0), topFirst(true), width(0), height(0), format(""), field(nullptr), tiled(nullptr) {}
+
+Raster::~Raster(){
+	delete field;
+	if(map != MAP_FAILED)
+		munmap(map, length);
+}
+
+int Raster::getWidth() const {
+	return width;
+}
+
+int Raster::getHeight() const {
+	return height;
+}
+
+const char* Raster::getFormat() const {
+	return format;
+}
+
+size_t Raster::getMappedBytes() const {
+	return length;
+}
+
+const ScalarField &Raster::getField() const {
+	return *field;
+}
+
+size_t Raster::getRowBytes() const {
+	return static_cast<size_t>(width) * sampleBytes;
+}
+
+size_t Raster::getCacheBytes() const {
+	return tiled ? tiled->getCacheBytes() : 0;
+}
+
+uint64_t Raster::getFailedTiles() const {
+	return tiled ? tiled->getFailedTiles() : 0;
+}
+
+bool Raster::isTopFirst() const {
+	return topFirst;
+}
+
+void Raster::prefetchRows(int row0, int row1, float isovalue) const {
+	adviseRows(row0, row1, MADV_WILLNEED, isovalue);
+}
+
+void Raster::releaseRows(int row0, int row1) const {
+	adviseRows(row0, row1, MADV_DONTNEED, 0.0f);
+}
+
+// Widened to whole pages; a neighbouring row that shares a page with the
+// range is simply read again.
+void Raster::adviseRows(int row0, int row1, int advice, float isovalue) const {
+	if(row0 < 0)
+		row0 = 0;
+	if(row1 > height)
+		row1 = height;
+	if(row0 >= row1)
+		return;
+	// Tiles the index rules out are skipped by the readers, so do not read them ahead either.
+	if(tiled && advice == MADV_WILLNEED){
+		tiled->prefetchRows(row0, row1, isovalue);
+		return;
+	}
+	size_t begin, end;
+	if(tiled){
+		tiled->getFileRange(row0, row1, begin, end);
+	} else {
+		const int first = topFirst ? height - row1 : row0;
+		begin = dataOffset + static_cast<size_t>(first) * getRowBytes();
+		end = begin + static_cast<size_t>(row1 - row0) * getRowBytes();
+	}
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t alignedBegin = begin / page * page;
+	madvise(static_cast<char*>(map) + alignedBegin, end - alignedBegin, advice);
+}
+
+Raster* openRaster(const char* path){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0){
+		fprintf(stderr, "ERROR: cannot open raster '%s': %s\n", path, strerror(errno));
+		return nullptr;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < 2){
+		fprintf(stderr, "ERROR: raster '%s' is empty or unreadable\n", path);
+		close(fd);
+		return nullptr;
+	}
+
+	Raster* raster = new Raster();
+	raster->length = static_cast<size_t>(st.st_size);
+	raster->map = mmap(nullptr, raster->length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(raster->map == MAP_FAILED){
+		fprintf(stderr, "ERROR: cannot map raster '%s': %s\n", path, strerror(errno));
+		delete raster;
+		return nullptr;
+	}
+	// Engines sweep the field row by row, so let the kernel read ahead
+	// aggressively and drop pages behind.
+	madvise(raster->map, raster->length, MADV_SEQUENTIAL);
+
+	const uint8_t* data = static_cast<const uint8_t*>(raster->map);
+	const size_t length = raster->length;
+	size_t pos = 0;
+	size_t sampleBytes = 0;
+	bool topFirst = true;
+	float scale = 1.0f, offset = 0.0f;
+	char token[64];
+
+	if(length >= RASTER_HEADER_BYTES && memcmp(data, "MSQR", 4) == 0){
+		uint32_t type = readLE32(data + 4);
+		uint32_t w = readLE32(data + 8), h = readLE32(data + 12);
+		uint32_t s = readLE32(data + 16), o = readLE32(data + 20);
+		memcpy(&scale, &s, sizeof(scale));
+		memcpy(&offset, &o, sizeof(offset));
+		if(type != RASTER_FLOAT32 && type != RASTER_UINT16){
+			fprintf(stderr, "ERROR: raster '%s' has unknown sample type %u\n", path, type);
+			delete raster;
+			return nullptr;
+		}
+		if(w == 0 || h == 0 || w > INT_MAX || h > INT_MAX){
+			fprintf(stderr, "ERROR: raster '%s' has invalid size %ux%u\n", path, w, h);
+			delete raster;
+			return nullptr;
+		}
+		raster->width = static_cast<int>(w);
+		raster->height = static_cast<int>(h);
+		raster->format = type == RASTER_FLOAT32 ? "float32" : "uint16";
+		sampleBytes = type == RASTER_FLOAT32 ? 4 : 2;
+		pos = RASTER_HEADER_BYTES;
+	} else if(length >= 4 && memcmp(data, "MSQT", 4) == 0){
+		TiledField* tiled = TiledField::open(path, data, length);
+		if(!tiled){
+			delete raster;
+			return nullptr;
+		}
+		static const char* const formats[] = { "tiled", "tiled-lz4", "tiled-zstd" };
+		raster->field = tiled;
+		raster->tiled = tiled;
+		raster->width = tiled->getWidth();
+		raster->height = tiled->getHeight();
+		raster->format = formats[tiled->getCodec()];
+		raster->sampleBytes = sizeof(float);
+		raster->topFirst = false;
+		return raster;
+	} else if(data[0] == 'P' && data[1] == '5'){
+		pos = 2;
+		int maxval;
+		if(!readDimension(data, length, pos, raster->width) || !readDimension(data, length, pos, raster->height)
+				|| !readDimension(data, length, pos, maxval) || maxval > 65535){
+			fprintf(stderr, "ERROR: raster '%s' has a malformed PGM header\n", path);
+			delete raster;
+			return nullptr;
+		}
+		// Exactly one whitespace character separates the header from the samples.
+		pos++;
+		sampleBytes = maxval < 256 ? 1 : 2;
+		raster->format = sampleBytes == 1 ? "pgm8" : "pgm16";
+		scale = 2.0f / maxval;
+	} else if(data[0] == 'P' && (data[1] == 'f' || data[1] == 'F')){
+		if(data[1] == 'F'){
+			fprintf(stderr, "ERROR: raster '%s' is a color PFM, only grayscale (Pf) is supported\n", path);
+			delete raster;
+			return nullptr;
+		}
+		pos = 2;
+		double byteOrder = 0.0;
+		char* end = token;
+		if(readDimension(data, length, pos, raster->width) && readDimension(data, length, pos, raster->height)
+				&& readToken(data, length, pos, token, sizeof(token)))
+			byteOrder = strtod(token, &end);
+		if(byteOrder == 0.0 || *end != '\0'){
+			fprintf(stderr, "ERROR: raster '%s' has a malformed PFM header\n", path);
+			delete raster;
+			return nullptr;
+		}
+		pos++;
+		sampleBytes = 4;
+		// The sign of the scale gives the byte order: negative is little-endian.
+		raster->format = byteOrder < 0.0 ? "pfm" : "pfm-be";
+		// PFM rows are stored bottom first, the grid's own order.
+		topFirst = false;
+	} else {
+		fprintf(stderr, "ERROR: raster '%s' is not a raw (MSQR), tiled (MSQT), PGM (P5) or PFM (Pf) file\n", path);
+		delete raster;
+		return nullptr;
+	}
+
+	const uint64_t needed = static_cast<uint64_t>(raster->width) * raster->height * sampleBytes;
+	if(pos > length || length - pos < needed){
+		fprintf(stderr, "ERROR: raster '%s' is truncated, %dx%d %s needs %llu bytes of samples\n",
+				path, raster->width, raster->height, raster->format, static_cast<unsigned long long>(needed));
+		delete raster;
+		return nullptr;
+	}
+
+	raster->dataOffset = pos;
+	raster->sampleBytes = sampleBytes;
+	raster->topFirst = topFirst;
+	const uint8_t* samples = data + pos;
+	const int w = raster->width, h = raster->height;
+	if(strcmp(raster->format, "float32") == 0 || strcmp(raster->format, "pfm") == 0)
+		raster->field = makeField<le32f_t>(samples, w, h, topFirst, scale, offset);
+	else if(strcmp(raster->format, "pfm-be") == 0)
+		raster->field = makeField<be32f_t>(samples, w, h, topFirst, scale, offset);
+	else if(strcmp(raster->format, "uint16") == 0)
+		raster->field = makeField<le16_t>(samples, w, h, topFirst, scale, offset);
+	else if(strcmp(raster->format, "pgm16") == 0)
+		raster->field = makeField<be16_t>(samples, w, h, topFirst, scale, offset);
+	else
+		raster->field = makeField<uint8_t>(samples, w, h, topFirst, scale, offset);
+	return raster;
+}
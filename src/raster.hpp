@@ -0,0 +1,122 @@
+#ifndef __RASTER_HPP__
+#define __RASTER_HPP__
+
+#include "field.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Little-endian values as they sit in a file. Assembled byte by byte, so they
+// need no alignment and read the same on any host; compilers turn that into a
+// plain (or byte-swapping) load.
+inline uint32_t readLE32(const uint8_t* p){
+	return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline uint64_t readLE64(const uint8_t* p){
+	return static_cast<uint64_t>(readLE32(p)) | static_cast<uint64_t>(readLE32(p + 4)) << 32;
+}
+
+inline float readLE32f(const uint8_t* p){
+	uint32_t u = readLE32(p);
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+inline void writeLE32(uint8_t *p, uint32_t v){
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = v >> 24;
+}
+
+inline void writeLE64(uint8_t *p, uint64_t v){
+	writeLE32(p, static_cast<uint32_t>(v));
+	writeLE32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+inline void writeLE32f(uint8_t *p, float f){
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	writeLE32(p, u);
+}
+
+struct le32f_t {
+	uint8_t b[4];
+	operator float() const { return readLE32f(b); }
+};
+
+// Raw raster layout, all little-endian, rows stored top first:
+//   0  char[4] magic "MSQR"
+//   4  uint32  sample type (RASTER_FLOAT32 or RASTER_UINT16)
+//   8  uint32  width
+//   12 uint32  height
+//   16 float32 scale
+//   20 float32 offset, the field is sample * scale + offset
+//   24 uint32[2] reserved, zero
+//   32 samples
+enum raster_type_t {
+	RASTER_FLOAT32 = 0,
+	RASTER_UINT16 = 1
+};
+
+static const size_t RASTER_HEADER_BYTES = 32;
+
+class TiledField;
+
+// A raster file mapped read-only. The field samples the mapping in place, so
+// the file is paged in from the page cache on demand and never copied; it is
+// only valid while the Raster lives.
+class Raster {
+	public:
+		~Raster();
+
+		int getWidth() const;
+		int getHeight() const;
+		// Sample encoding, e.g. "float32" or "pgm16".
+		const char* getFormat() const;
+		size_t getMappedBytes() const;
+		const ScalarField &getField() const;
+		// Bytes of one row of samples in the file, decoded for tiled containers.
+		size_t getRowBytes() const;
+		// Memory the field keeps on top of the mapping, e.g. decoded tiles.
+		size_t getCacheBytes() const;
+		// Tiles of a tiled container that failed to decode so far, see
+		// TiledField::getFailedTiles; zero for other formats.
+		uint64_t getFailedTiles() const;
+		// True if the file stores the top row first, so reading the grid
+		// from the top down is sequential on disk.
+		bool isTopFirst() const;
+		// Starts reading grid rows [row0, row1) into the page cache; for tiled
+		// containers only the tiles whose range includes isovalue.
+		void prefetchRows(int row0, int row1, float isovalue) const;
+		// Drops grid rows [row0, row1) from this process; they are read
+		// again if touched later.
+		void releaseRows(int row0, int row1) const;
+
+	private:
+		friend Raster* openRaster(const char* path);
+		Raster();
+
+		void adviseRows(int row0, int row1, int advice, float isovalue) const;
+
+		void* map;
+		size_t length;
+		size_t dataOffset;
+		size_t sampleBytes;
+		bool topFirst;
+		int width, height;
+		const char* format;
+		ScalarField* field;
+		// Also field, for tiled containers.
+		const TiledField* tiled;
+};
+
+// Maps a raw raster (above), tiled container (src/tiled.hpp), binary PGM (P5,
+// 8 or 16 bit) or grayscale PFM (Pf) with MADV_SEQUENTIAL. PGM samples are scaled so the isoline is at half of
+// maxval, PFM samples are used as they are. Returns nullptr on failure.
+Raster* openRaster(const char* path);
+
+#endif
@@ -0,0 +1,61 @@
+#include "resolution.hpp"
+
+// Coarsen above HIGH of the budget, refine only if the finer grid is predicted below LOW.
+static const double HIGH = 0.95;
+static const double LOW = 0.6;
+static const double SMOOTHING = 0.1;
+
+ResolutionController::ResolutionController(int res, double budgetSeconds)
+	: res(res), budget(budgetSeconds), smoothed(0.0), primed(false), cooldown(0),
+	windowTime(0.0), windowSamples(0), windowChanges(0) {}
+
+int ResolutionController::getResolution() const {
+	return res;
+}
+
+bool ResolutionController::isAdaptive() const {
+	return budget > 0.0;
+}
+
+int ResolutionController::update(double extractSeconds){
+	windowTime += extractSeconds;
+	windowSamples++;
+	if(!isAdaptive())
+		return res;
+	if(cooldown > 0){
+		cooldown--;
+		return res;
+	}
+
+	smoothed = primed ? smoothed + SMOOTHING * (extractSeconds - smoothed) : extractSeconds;
+	primed = true;
+
+	int next = res;
+	if(smoothed > budget * HIGH && res < MAX_RES){
+		next = res + 1;
+	} else if(res > MIN_RES){
+		const double ratio = static_cast<double>(res) / (res - 1);
+		if(smoothed * ratio * ratio < budget * LOW)
+			next = res - 1;
+	}
+	if(next != res){
+		res = next;
+		primed = false;
+		cooldown = COOLDOWN;
+		windowChanges++;
+	}
+	return res;
+}
+
+void ResolutionController::report(FILE* out){
+	if(windowSamples == 0)
+		return;
+	const double avg = windowTime / windowSamples;
+	if(isAdaptive())
+		fprintf(out, "  resolution: %d px/cell, extract %.3f ms of %.3f ms budget (%.0f%%), %d changes\n",
+				res, avg * 1000.0, budget * 1000.0, 100.0 * avg / budget, windowChanges);
+	else
+		fprintf(out, "  resolution: %d px/cell (fixed), extract %.3f ms\n", res, avg * 1000.0);
+	windowTime = 0.0;
+	windowSamples = windowChanges = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef __RESOLUTION_HPP__
+#define __RESOLUTION_HPP__
+
+#include <cstdio>
+
+// Picks the grid resolution (pixels per cell) that keeps contour extraction
+// within a time budget. Extraction times are smoothed, and a change is only
+// made when the current resolution is over budget or when the predicted cost
+// of the next finer one (cells grow with 1/res^2) is comfortably under it, so
+// a steady load does not flip between two resolutions. After a change, the
+// next few samples are ignored while frames at the old resolution drain.
+class ResolutionController {
+	public:
+		static const int MIN_RES = 1;
+		static const int MAX_RES = 32;
+
+		// A budget of zero keeps res fixed.
+		ResolutionController(int res, double budgetSeconds);
+
+		// Feeds the extraction time of one contour, returns the resolution for the next.
+		int update(double extractSeconds);
+		int getResolution() const;
+		bool isAdaptive() const;
+
+		// Resolution and budget use since the last report, then starts a new window.
+		void report(FILE* out);
+
+	private:
+		static const int COOLDOWN = 10;
+
+		int res;
+		double budget;
+		double smoothed;
+		bool primed;
+		int cooldown;
+		double windowTime;
+		int windowSamples;
+		int windowChanges;
+};
+
+#endif
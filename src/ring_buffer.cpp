@@ -0,0 +1,115 @@
+#include "ring_buffer.hpp"
+#include "glext.hpp"
+
+#include <cstdio>
+
+RingBuffer::RingBuffer()
+	: bufferID(0), slotBytes(0), persistent(false), mapped(nullptr), writeSlot(0), drawSlot(0), drawFenced(true) {
+	for(int i = 0; i < SLOTS; i++)
+		fences[i] = nullptr;
+}
+
+RingBuffer::~RingBuffer(){
+	release();
+}
+
+void RingBuffer::release(){
+	for(int i = 0; i < SLOTS; i++)
+		waitSlot(i);
+	if(mapped){
+		glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		mapped = nullptr;
+	}
+	if(bufferID){
+		glDeleteBuffers(1, &bufferID);
+		bufferID = 0;
+	}
+	persistent = false;
+	slotBytes = 0;
+}
+
+void RingBuffer::waitSlot(int slot){
+	if(!fences[slot])
+		return;
+	GLenum status;
+	do {
+		status = glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	} while(status == GL_TIMEOUT_EXPIRED);
+	if(status == GL_WAIT_FAILED)
+		fprintf(stderr, "ERROR: glClientWaitSync failed on ring slot %d\n", slot);
+	glDeleteSync(fences[slot]);
+	fences[slot] = nullptr;
+}
+
+bool RingBuffer::reserve(size_t bytes){
+	if(bufferID && bytes <= slotBytes)
+		return false;
+	size_t size = slotBytes * 2 > bytes ? slotBytes * 2 : bytes;
+	release();
+
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+	if(GLEXT_buffer_storage){
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size * SLOTS, NULL, flags);
+		mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size * SLOTS, flags));
+		if(!mapped){
+			fprintf(stderr, "ERROR: cannot map persistent ring buffer, falling back to glBufferData\n");
+			glDeleteBuffers(1, &bufferID);
+			glGenBuffers(1, &bufferID);
+		}
+	}
+	persistent = mapped != nullptr;
+	if(!persistent)
+		staging.resize(size);
+	slotBytes = size;
+	writeSlot = drawSlot = 0;
+	drawFenced = true;
+	return true;
+}
+
+void* RingBuffer::beginWrite(){
+	if(!persistent)
+		return staging.data();
+	// A region that was committed but never drawn can be overwritten in place.
+	writeSlot = drawFenced ? (drawSlot + 1) % SLOTS : drawSlot;
+	waitSlot(writeSlot);
+	return mapped + writeSlot * slotBytes;
+}
+
+void RingBuffer::commit(size_t bytes){
+	if(!persistent){
+		glBindBuffer(GL_ARRAY_BUFFER, bufferID);
+		glBufferData(GL_ARRAY_BUFFER, bytes, staging.data(), GL_DYNAMIC_DRAW);
+	}
+	drawSlot = writeSlot;
+	drawFenced = false;
+}
+
+// A region is redrawn every frame until the next commit, so each draw
+// replaces its fence; the newest one completes after all of them.
+void RingBuffer::fence(){
+	if(!persistent)
+		return;
+	if(fences[drawSlot])
+		glDeleteSync(fences[drawSlot]);
+	fences[drawSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	drawFenced = true;
+}
+
+GLuint RingBuffer::getID() const {
+	return bufferID;
+}
+
+size_t RingBuffer::getSlotBytes() const {
+	return slotBytes;
+}
+
+size_t RingBuffer::getDrawOffset() const {
+	return persistent ? drawSlot * slotBytes : 0;
+}
+
+bool RingBuffer::isPersistent() const {
+	return persistent;
+}
@@ -0,0 +1,53 @@
+#ifndef __RING_BUFFER_HPP__
+#define __RING_BUFFER_HPP__
+
+#include "glad/glad.h"
+
+#include <cstddef>
+#include <vector>
+
+// Streaming vertex buffer split into SLOTS regions. With buffer storage the
+// whole buffer is mapped once (persistent + coherent) and every region is
+// guarded by a fence placed after the draw that reads it, so the CPU writes
+// the next region while the GPU still reads the previous ones. Without it,
+// writes go to a client-side staging copy that is re-specified on commit.
+class RingBuffer {
+	public:
+		static const int SLOTS = 3;
+
+		RingBuffer();
+		~RingBuffer();
+
+		// Returns true if the buffer object was (re)created, i.e. VAO bindings need refreshing.
+		bool reserve(size_t slotBytes);
+
+		// Waits until the next writable region is free and returns it.
+		void* beginWrite();
+		void commit(size_t bytes);
+		// Call after every draw reading the committed region has been submitted.
+		void fence();
+
+		GLuint getID() const;
+		size_t getSlotBytes() const;
+		// Byte offset of the last committed region within the buffer.
+		size_t getDrawOffset() const;
+		bool isPersistent() const;
+
+	private:
+		void release();
+		void waitSlot(int slot);
+
+		GLuint bufferID;
+		size_t slotBytes;
+		bool persistent;
+		unsigned char* mapped;
+		std::vector<unsigned char> staging;
+		GLsync fences[SLOTS];
+		int writeSlot;
+		int drawSlot;
+		// False from a commit until the region is first drawn, when beginWrite may
+		// still overwrite it in place.
+		bool drawFenced;
+};
+
+#endif
@@ -1,10 +1,16 @@
 #include "shader.hpp"
+#include "embedded_shaders.hpp"
+#include "glext.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
-Shader::Shader(){
+Shader::Shader() : pending(false), fromCache(false), submitTime(0.0), buildTime(0.0) {
 	programID = glCreateProgram();
 }
 
@@ -12,41 +18,62 @@ unsigned int Shader::getID() const {
 	return programID;
 }
 
-int Shader::loadShader(const char* filePath, int type){
+int Shader::loadShader(const char* name, int type){
 	std::string code;
-	std::ifstream shaderFile;
-	std::stringstream shaderStream;
-	
-	shaderFile.open(filePath);
-	if(!shaderStream){
-		std::cerr << "OPENSDL::SHADER::Shader::Cannot load shader file: " << filePath << std::endl;
-		exit(1);
+	if(sourceDir.empty()){
+		const embedded_shader_t* shader = EMBEDDED_SHADERS;
+		while(shader->name && strcmp(shader->name, name) != 0)
+			shader++;
+		if(!shader->name){
+			std::cerr << "OPENSDL::SHADER::Shader::No embedded shader named: " << name << std::endl;
+			exit(1);
+		}
+		code = shader->code;
 	}
-	shaderStream << shaderFile.rdbuf();
-	shaderFile.close();
+	else {
+		std::string filePath = sourceDir + "/" + name;
+		std::ifstream shaderFile;
+		std::stringstream shaderStream;
+
+		shaderFile.open(filePath);
+		if(!shaderFile){
+			std::cerr << "OPENSDL::SHADER::Shader::Cannot load shader file: " << filePath << std::endl;
+			exit(1);
+		}
+		shaderStream << shaderFile.rdbuf();
+		shaderFile.close();
+
+		code = shaderStream.str();
+	}
+
+	stages.push_back({type, code});
 
-	code = shaderStream.str();
+	return 0;
+}
 
-	const char* codeChar = code.c_str();
-	unsigned int shaderID = glCreateShader(type);
-	glShaderSource(shaderID, 1, &codeChar, NULL);
-	glCompileShader(shaderID);
-	std::string typeS;
+static const char* stageName(int type){
 	switch (type) {
 		case GL_VERTEX_SHADER:
-			typeS = "VERTEX";
-			break;
+			return "VERTEX";
 		case GL_FRAGMENT_SHADER:
-			typeS = "FRAGMENT";
-			break;
+			return "FRAGMENT";
 	}
-	checkCompileErrors(shaderID, typeS);
+	return "";
+}
 
-	glAttachShader(programID, shaderID);
-	
-	shadersID.push_back(shaderID);
+// Only queues the work: no status is queried here, so with
+// KHR_parallel_shader_compile the driver compiles on its own threads.
+void Shader::compileSources(){
+	for(const stage_t &stage : stages){
+		const char* codeChar = stage.code.c_str();
+		unsigned int shaderID = glCreateShader(stage.type);
+		glShaderSource(shaderID, 1, &codeChar, NULL);
+		glCompileShader(shaderID);
 
-	return 0;
+		glAttachShader(programID, shaderID);
+
+		shadersID.push_back(shaderID);
+	}
 }
 
 Shader::~Shader(){
@@ -54,18 +81,172 @@ Shader::~Shader(){
 }
 
 void Shader::compileShaders(){
-	glLinkProgram(programID);
-	checkCompileErrors(programID, "PROGRAM");
+	submit();
+	if(pending)
+		finishLink();
+}
+
+void Shader::submit(){
+	submitStart = std::chrono::steady_clock::now();
+	cachePath.clear();
+	if(!cacheDir.empty())
+		cachePath = cacheDir + "/" + cacheKey() + ".bin";
+
+	fromCache = !cachePath.empty() && loadBinary(cachePath);
+	if(!fromCache){
+		if(!cachePath.empty())
+			glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		compileSources();
+		glLinkProgram(programID);
+		pending = true;
+	}
+	submitTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - submitStart).count();
+	if(!pending)
+		buildTime = submitTime;
+}
+
+bool Shader::poll(){
+	if(!pending)
+		return true;
+	if(GLEXT_parallel_shader_compile){
+		int done = GL_FALSE;
+		glGetProgramiv(programID, GL_COMPLETION_STATUS_KHR, &done);
+		if(!done)
+			return false;
+	}
+	finishLink();
+	return true;
+}
+
+bool Shader::isReady() const {
+	return !pending;
+}
+
+void Shader::finishLink(){
+	for(size_t i = 0; i < shadersID.size(); i++)
+		checkCompileErrors(shadersID[i], stageName(stages[i].type));
+	if(checkCompileErrors(programID, "PROGRAM") == 0 && !cachePath.empty())
+		saveBinary(cachePath);
 
 	for(unsigned int shaderID : shadersID){
 		glDeleteShader(shaderID);
 	}
+	shadersID.clear();
+	pending = false;
+	buildTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - submitStart).count();
+}
+
+void Shader::setSourceDir(const char* dir){
+	sourceDir = dir ? dir : "";
+}
+
+void Shader::setBinaryCache(const char* dir){
+	cacheDir = dir ? dir : "";
+}
+
+bool Shader::isFromCache() const {
+	return fromCache;
+}
+
+double Shader::getBuildTime() const {
+	return buildTime;
+}
+
+double Shader::getSubmitTime() const {
+	return submitTime;
+}
+
+// FNV-1a over the driver identity and every stage, so a driver update or an
+// edited shader simply misses instead of feeding the driver a stale binary.
+std::string Shader::cacheKey() const {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	auto mix = [&hash](const void* data, size_t len){
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for(size_t i = 0; i < len; i++){
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+	};
+	const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for(GLenum name : names){
+		const char* str = reinterpret_cast<const char*>(glGetString(name));
+		if(str)
+			mix(str, strlen(str) + 1);
+	}
+	for(const stage_t &stage : stages){
+		mix(&stage.type, sizeof(stage.type));
+		mix(stage.code.data(), stage.code.size());
+	}
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return hex;
+}
+
+bool Shader::loadBinary(const std::string &path){
+	std::ifstream file(path, std::ios::binary);
+	if(!file)
+		return false;
+	uint32_t header[3];
+	if(!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != 0x42515353)
+		return false;
+	// The length comes from the file, so a truncated or corrupt entry must not
+	// be able to ask for more than the file holds.
+	const std::streampos start = file.tellg();
+	file.seekg(0, std::ios::end);
+	const std::streamoff left = file.tellg() - start;
+	if(start < 0 || left < 0 || header[2] == 0 || static_cast<uint64_t>(left) < header[2])
+		return false;
+	file.seekg(start);
+	std::vector<char> binary(header[2]);
+	if(!file.read(binary.data(), binary.size()))
+		return false;
+
+	glProgramBinary(programID, header[1], binary.data(), binary.size());
+	int success;
+	glGetProgramiv(programID, GL_LINK_STATUS, &success);
+	if(success)
+		return true;
+
+	// Rejected (driver changed underneath the key, corrupt file, ...): start over from source.
+	std::cerr << "OPENSDL::SHADER::Shader::Cached program binary rejected, recompiling: " << path << std::endl;
+	glDeleteProgram(programID);
+	programID = glCreateProgram();
+	return false;
+}
+
+void Shader::saveBinary(const std::string &path){
+	int length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(programID, length, &length, &format, binary.data());
+
+	std::string tmpPath = path + ".tmp";
+	std::ofstream file(tmpPath, std::ios::binary);
+	uint32_t header[3] = { 0x42515353, format, static_cast<uint32_t>(length) };
+	file.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file.write(binary.data(), length);
+	file.close();
+	if(!file || std::rename(tmpPath.c_str(), path.c_str()) != 0){
+		std::cerr << "OPENSDL::SHADER::Shader::Cannot write program binary cache: " << path << std::endl;
+		std::remove(tmpPath.c_str());
+	}
 }
 
 void Shader::use(){
 	glUseProgram(programID);
 }
 
+void Shader::setVec2(const char* name, float x, float y){
+	glUniform2f(glGetUniformLocation(programID, name), x, y);
+}
+
+void Shader::setVec4(const char* name, float x, float y, float z, float w){
+	glUniform4f(glGetUniformLocation(programID, name), x, y, z, w);
+}
+
 int Shader::checkCompileErrors(unsigned int shader, std::string type) {
 	int success;
 	char infoLog[1024];
@@ -3,6 +3,7 @@
 
 #include "glad/glad.h"
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -12,15 +13,60 @@ class Shader {
 		~Shader();
 
 		void use();
+		// Links the loaded stages, or restores the program from the binary
+		// cache when a matching entry exists and the driver accepts it.
+		// Blocks until the program is usable; equivalent to submit() + waiting.
 		void compileShaders();
+		// Non-blocking variant: queues compile and link, then poll() once per
+		// frame until it returns true. With KHR_parallel_shader_compile the
+		// driver builds on its own threads meanwhile; without it the first
+		// poll() blocks.
+		void submit();
+		bool poll();
+		bool isReady() const;
 		unsigned int getID() const;
+		void setVec2(const char* name, float x, float y);
+		void setVec4(const char* name, float x, float y, float z, float w);
 
-		int loadShader(const char* filePath, int type);
+		// Takes the stage source from the copy embedded at build time, or from
+		// sourceDir/name if setSourceDir() was called. Compilation is deferred
+		// to compileShaders().
+		int loadShader(const char* name, int type);
 		int checkCompileErrors(unsigned int shader, std::string type);
 
+		// Development override: read shaders from disk instead, e.g. "shaders".
+		void setSourceDir(const char* dir);
+
+		// Directory for linked program binaries, nullptr disables caching.
+		void setBinaryCache(const char* dir);
+		bool isFromCache() const;
+		// Seconds from submit() until the program was ready, and the part of that spent inside submit().
+		double getBuildTime() const;
+		double getSubmitTime() const;
+
 	private:
+		struct stage_t {
+			int type;
+			std::string code;
+		};
+
+		std::string cacheKey() const;
+		bool loadBinary(const std::string &path);
+		void saveBinary(const std::string &path);
+		void compileSources();
+		void finishLink();
+
 		unsigned int programID;
 		std::vector<int> shadersID;
+		std::vector<stage_t> stages;
+		std::string sourceDir;
+		std::string cacheDir;
+		std::string cachePath;
+		bool pending;
+		bool fromCache;
+		std::chrono::steady_clock::time_point submitStart;
+		double submitTime;
+		double buildTime;
 
 };
 
@@ -0,0 +1,87 @@
+#include "sim_thread.hpp"
+#include "simulation.hpp"
+#include "field.hpp"
+
+#include <chrono>
+
+SimulationThread::SimulationThread(ContourEngine* engine, const std::vector<sphere_t> &spheres, int width, int height, int res, float isovalue)
+	: engine(engine), spheres(spheres), width(width), height(height), res(res), isovalue(isovalue), running(false), steps(0), dropped(0) {}
+
+SimulationThread::~SimulationThread(){
+	stop();
+	delete engine;
+}
+
+void SimulationThread::start(){
+	running = true;
+	thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop(){
+	running = false;
+	if(thread.joinable())
+		thread.join();
+}
+
+bool SimulationThread::acquire(){
+	return frames.acquire();
+}
+
+const contour_frame_t& SimulationThread::latest(){
+	return frames.readBuffer();
+}
+
+int SimulationThread::takeSteps(){
+	return steps.exchange(0);
+}
+
+int SimulationThread::takeDropped(){
+	return dropped.exchange(0);
+}
+
+void SimulationThread::setResolution(int res){
+	this->res = res;
+}
+
+void SimulationThread::setSize(int width, int height){
+	this->width = width;
+	this->height = height;
+}
+
+void SimulationThread::setIsovalue(float isovalue){
+	this->isovalue = isovalue;
+}
+
+void SimulationThread::run(){
+	typedef std::chrono::steady_clock clock;
+	const double fpsLimit = 1.0/60.0;
+	clock::time_point lastTime = clock::now();
+	double dt = 1.0;
+	unsigned long seq = 0;
+	const MetaballField metaballs(spheres);
+	while(running){
+		clock::time_point nowTime = clock::now();
+		dt += std::chrono::duration<double>(nowTime - lastTime).count() / fpsLimit;
+		lastTime = nowTime;
+		if(dt < 1.0){
+			std::this_thread::sleep_for(std::chrono::duration<double>((1.0 - dt) * fpsLimit));
+			continue;
+		}
+
+		contour_frame_t &frame = frames.writeBuffer();
+		clock::time_point t0 = clock::now();
+		int skipped = 0;
+		frame.steps = advanceSimulation(spheres, dt, skipped);
+		dropped += skipped;
+		clock::time_point t1 = clock::now();
+		frame.grid = makeGrid(width, height, res);
+		extractToVector(engine, frame.grid, IsovalueField(metaballs, isovalue), frame.verts);
+		clock::time_point t2 = clock::now();
+
+		frame.simulateTime = std::chrono::duration<double>(t1 - t0).count();
+		frame.extractTime = std::chrono::duration<double>(t2 - t1).count();
+		frame.seq = ++seq;
+		steps += frame.steps;
+		frames.publish();
+	}
+}
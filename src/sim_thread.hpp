@@ -0,0 +1,63 @@
+#ifndef __SIM_THREAD_HPP__
+#define __SIM_THREAD_HPP__
+
+#include "contour.hpp"
+#include "triple_buffer.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// A finished contour together with what it took to produce it.
+struct contour_frame_t {
+	std::vector<vertex_t> verts;
+	grid_t grid;
+	unsigned long seq;
+	int steps;
+	double simulateTime;
+	double extractTime;
+};
+
+// Runs the 60 Hz physics and contour extraction on its own thread and hands
+// every finished contour to the render thread through a TripleBuffer, so a
+// slow extraction delays the next contour instead of the next frame.
+class SimulationThread {
+	public:
+		// Takes ownership of engine; spheres are copied.
+		SimulationThread(ContourEngine* engine, const std::vector<sphere_t> &spheres, int width, int height, int res, float isovalue);
+		~SimulationThread();
+
+		void start();
+		void stop();
+
+		// Render thread: true if a newer contour than the last acquired one is available.
+		bool acquire();
+		const contour_frame_t& latest();
+		// Physics steps taken / dropped since the last call.
+		int takeSteps();
+		int takeDropped();
+		// Grid resolution for the contours extracted from now on.
+		void setResolution(int res);
+		// Framebuffer size for the contours extracted from now on.
+		void setSize(int width, int height);
+		// Isovalue for the contours extracted from now on.
+		void setIsovalue(float isovalue);
+
+	private:
+		void run();
+
+		ContourEngine* engine;
+		std::vector<sphere_t> spheres;
+		// A contour that sees a new width with the old height is still a
+		// valid grid, so these are set independently.
+		std::atomic<int> width, height;
+		std::atomic<int> res;
+		std::atomic<float> isovalue;
+		std::thread thread;
+		std::atomic<bool> running;
+		std::atomic<int> steps;
+		std::atomic<int> dropped;
+		TripleBuffer<contour_frame_t> frames;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include "simulation.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
+void spawnSpheres(std::vector<sphere_t> &spheres){
+	for(int i = 0; i < std::rand() % 30 + 1; i++){
+		float rad = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.3f);
+		float x = (std::rand() % 2 == 0) ? -1.0f + rad : 0.0f;
+		float y = (std::rand() % 2 == 0) ? 1.0f - rad : 0.0f;
+		float velx  = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.010f);
+		float vely = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX/0.010f);
+		spheres.push_back({{x, y}, {velx, vely}, rad});
+	}
+}
+
+void stepSpheres(std::vector<sphere_t> &spheres, double dt){
+	for(auto &s : spheres){
+		if(s.pos.x - s.rad < -1 || s.pos.x + s.rad > 1) s.vel.x = -s.vel.x;
+		if(s.pos.y - s.rad < -1 || s.pos.y + s.rad > 1) s.vel.y = -s.vel.y;
+		s.pos.x += s.vel.x * dt;
+		s.pos.y += s.vel.y * dt;
+	}
+}
+
+int advanceSimulation(std::vector<sphere_t> &spheres, double &dt, int &dropped){
+	int steps = 0;
+	while(dt >= 1.0){
+		if(steps == MAX_CATCHUP_STEPS){
+			double skipped = std::floor(dt);
+			dropped += static_cast<int>(skipped);
+			dt -= skipped;
+			break;
+		}
+		stepSpheres(spheres, 1.0);
+		steps++;
+		dt--;
+	}
+	return steps;
+}
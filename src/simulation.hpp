@@ -0,0 +1,22 @@
+#ifndef __SIMULATION_HPP__
+#define __SIMULATION_HPP__
+
+#include "contour.hpp"
+
+#include <vector>
+
+// Between 1 and 30 spheres starting in the corners/centre, moving towards +x/+y.
+void spawnSpheres(std::vector<sphere_t> &spheres);
+// One physics step, bouncing off the NDC border. dt is in 60 Hz ticks.
+void stepSpheres(std::vector<sphere_t> &spheres, double dt);
+
+// Catch-up limit per rendered frame; beyond it steps are dropped rather than
+// letting a slow frame schedule even more work for the next one.
+const int MAX_CATCHUP_STEPS = 4;
+
+// Runs the steps due in the dt accumulator (in ticks), one tick each, at most
+// MAX_CATCHUP_STEPS, leaving the fractional remainder in dt. Returns the steps
+// run and adds the discarded ones to dropped.
+int advanceSimulation(std::vector<sphere_t> &spheres, double &dt, int &dropped);
+
+#endif
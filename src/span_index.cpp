@@ -0,0 +1,146 @@
+#include "span_index.hpp"
+#include "field.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+SpanIndex::SpanIndex() : blocksX(0), blocksY(0), root(-1), fieldLo(0.0f), fieldHi(0.0f), built(false) {}
+
+void SpanIndex::build(const grid_t &grid, const ScalarField &field){
+	this->grid = grid;
+	const int w = grid.wQuads;
+	const int h = grid.hQuads;
+	values.resize(static_cast<size_t>(w) * h);
+	evaluateField(grid, field, values.data(), 0, h);
+	fieldLo = *std::min_element(values.begin(), values.end());
+	fieldHi = *std::max_element(values.begin(), values.end());
+
+	// Block (bx, by) holds cells [bx * BLOCK, bx * BLOCK + BLOCK), so its
+	// samples reach one further.
+	blocksX = (w - 1 + BLOCK - 1) / BLOCK;
+	blocksY = (h - 1 + BLOCK - 1) / BLOCK;
+	std::vector<span_t> spans;
+	for(int by = 0; by < blocksY; by++){
+		const int i1 = std::min(by * BLOCK + BLOCK, h - 1);
+		for(int bx = 0; bx < blocksX; bx++){
+			const int j1 = std::min(bx * BLOCK + BLOCK, w - 1);
+			float lo = values[static_cast<size_t>(by * BLOCK) * w + bx * BLOCK], hi = lo;
+			for(int i = by * BLOCK; i <= i1; i++){
+				const float *row = values.data() + static_cast<size_t>(i) * w;
+				for(int j = bx * BLOCK; j <= j1; j++){
+					lo = std::min(lo, row[j]);
+					hi = std::max(hi, row[j]);
+				}
+			}
+			if(lo < hi)
+				spans.push_back({lo, hi, static_cast<uint32_t>(by * blocksX + bx)});
+		}
+	}
+
+	nodes.clear();
+	byMin.clear();
+	byMax.clear();
+	root = buildNode(spans.data(), spans.data() + spans.size());
+	built = true;
+}
+
+// Centred on the median span midpoint, which lies in that span, so every node
+// keeps at least one span and at most half of the rest go to either side.
+int SpanIndex::buildNode(span_t *first, span_t *last){
+	if(first == last)
+		return -1;
+	span_t *mid = first + (last - first) / 2;
+	std::nth_element(first, mid, last, [](const span_t &a, const span_t &b){ return a.lo + a.hi < b.lo + b.hi; });
+	const float center = (mid->lo + mid->hi) * 0.5f;
+	span_t *leftEnd = std::partition(first, last, [center](const span_t &s){ return s.hi < center; });
+	span_t *rightBegin = std::partition(leftEnd, last, [center](const span_t &s){ return s.lo <= center; });
+
+	const int index = static_cast<int>(nodes.size());
+	const uint32_t begin = static_cast<uint32_t>(byMin.size());
+	byMin.insert(byMin.end(), leftEnd, rightBegin);
+	byMax.insert(byMax.end(), leftEnd, rightBegin);
+	std::sort(byMin.begin() + begin, byMin.end(), [](const span_t &a, const span_t &b){ return a.lo < b.lo; });
+	std::sort(byMax.begin() + begin, byMax.end(), [](const span_t &a, const span_t &b){ return a.hi > b.hi; });
+	nodes.push_back({center, -1, -1, begin, static_cast<uint32_t>(byMin.size())});
+
+	const int left = buildNode(first, leftEnd);
+	const int right = buildNode(rightBegin, last);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+bool SpanIndex::covers(const grid_t &grid) const {
+	return built && grid.wQuads == this->grid.wQuads && grid.hQuads == this->grid.hQuads;
+}
+
+// Classifies exactly like an engine on IsovalueField, value + shift against 1.
+void SpanIndex::emitBlock(uint32_t block, float shift, vertex_writer_t &out) const {
+	const int w = grid.wQuads;
+	const int bx = block % blocksX;
+	const int by = block / blocksX;
+	const int i1 = std::min(by * BLOCK + BLOCK, grid.hQuads - 1);
+	const int j1 = std::min(bx * BLOCK + BLOCK, w - 1);
+	for(int i = by * BLOCK; i < i1; i++){
+		const float *lo = values.data() + static_cast<size_t>(i) * w;
+		const float *hi = lo + w;
+		for(int j = bx * BLOCK; j < j1; j++){
+			const int state = getState(lo[j] + shift >= 1, hi[j] + shift >= 1, hi[j+1] + shift >= 1, lo[j+1] + shift >= 1);
+			if(state != 0 && state != 15)
+				emitCellSegments(grid, state, j, i, out);
+		}
+	}
+}
+
+size_t SpanIndex::query(float isovalue, vertex_writer_t &out) const {
+	if(root < 0)
+		return 0;
+	const float shift = 1.0f - isovalue;
+	// A span holds the isoline if lo < t <= hi. The engines' v + shift >= 1
+	// can round the other way within a few ulps, so the search is padded and
+	// emitBlock decides.
+	const float pad = (std::fabs(isovalue) + 1.0f) * 1e-6f;
+	const float tLo = isovalue - pad;
+	const float tHi = isovalue + pad;
+
+	size_t visited = 0;
+	std::vector<int> stack(1, root);
+	while(!stack.empty()){
+		const node_t &node = nodes[stack.back()];
+		stack.pop_back();
+		if(tHi <= node.center){
+			// Every span here reaches up to center, above the query.
+			for(uint32_t k = node.begin; k < node.end && byMin[k].lo < tHi; k++, visited++)
+				emitBlock(byMin[k].block, shift, out);
+		} else if(tLo > node.center){
+			for(uint32_t k = node.begin; k < node.end && byMax[k].hi >= tLo; k++, visited++)
+				emitBlock(byMax[k].block, shift, out);
+		} else {
+			for(uint32_t k = node.begin; k < node.end; k++, visited++)
+				emitBlock(byMin[k].block, shift, out);
+		}
+		if(node.left >= 0 && tLo < node.center)
+			stack.push_back(node.left);
+		if(node.right >= 0 && tHi > node.center)
+			stack.push_back(node.right);
+	}
+	return visited;
+}
+
+bool SpanIndex::getRange(float &lo, float &hi) const {
+	lo = fieldLo;
+	hi = fieldHi;
+	return built;
+}
+
+size_t SpanIndex::getBlocks() const {
+	return static_cast<size_t>(blocksX) * blocksY;
+}
+
+size_t SpanIndex::getSpans() const {
+	return byMin.size();
+}
+
+size_t SpanIndex::getBytes() const {
+	return values.size() * sizeof(float) + nodes.size() * sizeof(node_t) + (byMin.size() + byMax.size()) * sizeof(span_t);
+}
@@ -0,0 +1,65 @@
+#ifndef __SPAN_INDEX_HPP__
+#define __SPAN_INDEX_HPP__
+
+#include "contour.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ScalarField;
+
+// Span-space index of a static field on one grid, for sweeping the isovalue.
+// build() samples the lattice once and files each block of BLOCK x BLOCK
+// cells under its [min, max] in a centred interval tree; a query at t then
+// only visits the blocks whose span contains t, O(log n + k) instead of a
+// scan of every cell. Blocks with a single value can never hold an isoline
+// and are left out.
+class SpanIndex {
+	public:
+		static const int BLOCK = 4;
+
+		SpanIndex();
+
+		void build(const grid_t &grid, const ScalarField &field);
+		// True if built for a grid of this size.
+		bool covers(const grid_t &grid) const;
+		// Writes the isoline at isovalue as GL_LINES pairs, like
+		// ContourEngine::extract on IsovalueField(field, isovalue). Returns
+		// the number of blocks visited.
+		size_t query(float isovalue, vertex_writer_t &out) const;
+
+		// Range of the field; false before build().
+		bool getRange(float &lo, float &hi) const;
+		size_t getBlocks() const;
+		// Blocks with more than one value, the ones in the tree.
+		size_t getSpans() const;
+		size_t getBytes() const;
+
+	private:
+		struct span_t {
+			float lo, hi;
+			uint32_t block;
+		};
+		struct node_t {
+			float center;
+			int left, right;
+			// Spans containing center, in byMin and byMax.
+			uint32_t begin, end;
+		};
+
+		int buildNode(span_t *first, span_t *last);
+		void emitBlock(uint32_t block, float shift, vertex_writer_t &out) const;
+
+		grid_t grid;
+		int blocksX, blocksY;
+		std::vector<float> values;
+		std::vector<node_t> nodes;
+		int root;
+		// Per node, its spans by ascending min and by descending max.
+		std::vector<span_t> byMin, byMax;
+		float fieldLo, fieldHi;
+		bool built;
+};
+
+#endif
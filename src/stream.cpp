@@ -0,0 +1,246 @@
+#include "stream.hpp"
+#include "export.hpp"
+#include "field.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Segments handed to the sink per call.
+static const size_t SEGMENT_BATCH = 4096;
+// Samples per bounds() query; a run the field can bound away from the
+// isoline is classified without being read.
+static const int CHUNK = 256;
+
+// Cell edges as in emitCell: bottom, right, top, left midpoints.
+static const float s_edgeX[4] = { 0.5f, 1.0f, 0.5f, 0.0f };
+static const float s_edgeY[4] = { 0.0f, 0.5f, 1.0f, 0.5f };
+// Edge pairs per case, -1 terminated; the same case table as extractReference.
+static const int8_t s_caseEdges[16][5] = {
+	{ -1 },
+	{ 0, 1, -1 },
+	{ 2, 1, -1 },
+	{ 2, 0, -1 },
+	{ 3, 2, -1 },
+	{ 3, 0, 2, 1, -1 },
+	{ 3, 1, -1 },
+	{ 3, 0, -1 },
+	{ 3, 0, -1 },
+	{ 3, 1, -1 },
+	{ 3, 2, 0, 1, -1 },
+	{ 3, 2, -1 },
+	{ 2, 0, -1 },
+	{ 2, 1, -1 },
+	{ 0, 1, -1 },
+	{ -1 }
+};
+
+bool RawSegmentSink::write(const segment_t *segments, size_t count){
+	return fwrite(segments, sizeof(segment_t), count, out) == count;
+}
+
+static size_t pageSize(){
+	return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Row of values, two rows of inside flags, a segment batch and the field's cache.
+static size_t fixedStreamBytes(const Raster &raster){
+	return static_cast<size_t>(raster.getWidth()) * (sizeof(float) + 2) + SEGMENT_BATCH * sizeof(segment_t) + raster.getCacheBytes();
+}
+
+// A band of rows, plus the page on each side it may be widened to.
+static size_t bandBytes(const Raster &raster, int rows){
+	return static_cast<size_t>(rows) * raster.getRowBytes() + 2 * pageSize();
+}
+
+size_t minStreamMemory(const Raster &raster){
+	return fixedStreamBytes(raster) + 2 * bandBytes(raster, 1);
+}
+
+int streamContour(const Raster &raster, float isovalue, size_t memoryBytes, SegmentSink &sink, stream_stats_t &stats){
+	const int w = raster.getWidth();
+	const int h = raster.getHeight();
+	stats = stream_stats_t();
+	if(w < 2 || h < 2){
+		fprintf(stderr, "ERROR: cannot contour a %dx%d raster\n", w, h);
+		return -1;
+	}
+	if(memoryBytes < minStreamMemory(raster)){
+		fprintf(stderr, "ERROR: streaming a %d sample wide raster needs at least %.1f MB\n", w, minStreamMemory(raster) / (1024.0 * 1024.0));
+		return -1;
+	}
+	size_t bandRows = (memoryBytes - fixedStreamBytes(raster)) / 2;
+	bandRows = bandRows > 2 * pageSize() ? (bandRows - 2 * pageSize()) / raster.getRowBytes() : 0;
+	stats.bandRows = bandRows < 1 ? 1 : (bandRows > static_cast<size_t>(h) ? h : static_cast<int>(bandRows));
+	stats.workingSet = fixedStreamBytes(raster) + 2 * bandBytes(raster, stats.bandRows);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const IsovalueField field(raster.getField(), isovalue);
+	// One lattice point per sample.
+	const grid_t grid = makeGrid(w - 1, h - 1, 1);
+	std::vector<float> values(w);
+	std::vector<uint8_t> inside[2] = { std::vector<uint8_t>(w), std::vector<uint8_t>(w) };
+	std::vector<segment_t> segments;
+	segments.reserve(SEGMENT_BATCH);
+
+	// Step t reads grid row rowAt(t), so t follows the file.
+	const bool down = raster.isTopFirst();
+	auto rowAt = [down, h](int t){ return down ? h - 1 - t : t; };
+	// Grid rows [row0, row1) of the steps [t0, t1).
+	auto advise = [&](int t0, int t1, bool prefetch){
+		if(t1 > h)
+			t1 = h;
+		if(t0 >= t1)
+			return;
+		const int row0 = down ? h - t1 : t0;
+		const int row1 = down ? h - t0 : t1;
+		if(prefetch)
+			raster.prefetchRows(row0, row1, isovalue);
+		else
+			raster.releaseRows(row0, row1);
+	};
+
+	const int band = stats.bandRows;
+	const uint64_t failedTiles = raster.getFailedTiles();
+	advise(0, band, true);
+	for(int t = 0; t < h; t++){
+		if(t % band == 0){
+			stats.bands++;
+			advise(t + band, t + 2 * band, true);
+			advise(t - band, t, false);
+		}
+		const int row = rowAt(t);
+		uint8_t *cur = inside[t & 1].data();
+		for(int c = 0; c < w; c += CHUNK){
+			const int n = w - c < CHUNK ? w - c : CHUNK;
+			const int side = boundedSide(field, grid, c, row, c + n - 1, row);
+			if(side >= 0){
+				memset(cur + c, side, n);
+				stats.skipped += n;
+				continue;
+			}
+			field.evaluate(grid, row, c, 1, n, values.data() + c);
+			for(int j = c; j < c + n; j++)
+				cur[j] = values[j] < 1 ? 0 : 1;
+		}
+		if(raster.getFailedTiles() != failedTiles){
+			fprintf(stderr, "ERROR: cannot read row %d of the raster, stopping after %llu segments\n", row, static_cast<unsigned long long>(stats.segments));
+			return -1;
+		}
+		if(t == 0)
+			continue;
+
+		// Cell row i lies between grid rows i and i + 1.
+		const int i = down ? row : row - 1;
+		const uint8_t *lo = down ? cur : inside[(t - 1) & 1].data();
+		const uint8_t *hi = down ? inside[(t - 1) & 1].data() : cur;
+		for(int j = 0; j < w - 1; j++){
+			// Most of a large raster is far from the isoline: skip eight
+			// samples, seven cells, at a time while both rows agree.
+			uint64_t a, b;
+			if(j + 8 <= w){
+				memcpy(&a, lo + j, sizeof(a));
+				memcpy(&b, hi + j, sizeof(b));
+				if(a == b && (a == 0 || a == UINT64_C(0x0101010101010101))){
+					j += 6;
+					continue;
+				}
+			}
+			const int state = getState(lo[j], hi[j], hi[j+1], lo[j+1]);
+			if(state == 0 || state == 15)
+				continue;
+			const int8_t *edges = s_caseEdges[state];
+			for(int e = 0; edges[e] >= 0; e += 2){
+				if(segments.size() == SEGMENT_BATCH){
+					if(!sink.write(segments.data(), segments.size())){
+						fprintf(stderr, "ERROR: contour sink failed after %llu segments\n", static_cast<unsigned long long>(stats.segments));
+						return -1;
+					}
+					segments.clear();
+				}
+				segments.push_back({j + s_edgeX[edges[e]], i + s_edgeY[edges[e]], j + s_edgeX[edges[e + 1]], i + s_edgeY[edges[e + 1]]});
+				stats.segments++;
+			}
+		}
+	}
+	advise(h - (h - 1) % band - 1, h, false);
+	if((!segments.empty() && !sink.write(segments.data(), segments.size())) || !sink.finish()){
+		fprintf(stderr, "ERROR: contour sink failed after %llu segments\n", static_cast<unsigned long long>(stats.segments));
+		return -1;
+	}
+
+	stats.bytesRead = static_cast<uint64_t>(h) * raster.getRowBytes() - stats.skipped * (raster.getRowBytes() / w);
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return 0;
+}
+
+// Counts, for --stream without an output file.
+class NullSegmentSink : public SegmentSink {
+	public:
+		bool write(const segment_t *segments, size_t count) { return true; }
+};
+
+int runStream(const char* path, const char* outPath, const char* format, float isovalue, size_t memoryBytes){
+	// The export thread's batch copies and the format's output buffer.
+	const size_t exportBytes = outPath ? AsyncSegmentSink::BUFFERS * SEGMENT_BATCH * sizeof(segment_t) + BufferedWriter::CAPACITY : 0;
+	if(memoryBytes <= exportBytes){
+		fprintf(stderr, "ERROR: exporting needs more than %.1f MB of --memory\n", exportBytes / (1024.0 * 1024.0));
+		return -1;
+	}
+	Raster* raster = openRaster(path);
+	if(!raster)
+		return -1;
+	FILE* out = nullptr;
+	SegmentSink* formatSink = nullptr;
+	if(outPath){
+		out = fopen(outPath, "wb");
+		if(!out){
+			fprintf(stderr, "ERROR: cannot open '%s' for writing\n", outPath);
+			delete raster;
+			return -1;
+		}
+		formatSink = createSegmentSink(format, out, raster->getWidth(), raster->getHeight(), isovalue);
+		if(!formatSink){
+			fprintf(stderr, "ERROR: unknown output format '%s'\n", format);
+			fclose(out);
+			delete raster;
+			return -1;
+		}
+	}
+	AsyncSegmentSink* asyncSink = formatSink ? new AsyncSegmentSink(*formatSink, SEGMENT_BATCH) : nullptr;
+	NullSegmentSink nullSink;
+	SegmentSink &sink = asyncSink ? static_cast<SegmentSink&>(*asyncSink) : nullSink;
+
+	printf("Stream: %s, %dx%d %s, %.1f MB\n", path, raster->getWidth(), raster->getHeight(), raster->getFormat(),
+			raster->getMappedBytes() / (1024.0 * 1024.0));
+	stream_stats_t stats;
+	int status = streamContour(*raster, isovalue, memoryBytes - exportBytes, sink, stats);
+	const double samples = static_cast<double>(raster->getWidth()) * raster->getHeight();
+	const double stalled = asyncSink ? asyncSink->getStallSeconds() : 0.0;
+	delete asyncSink;
+	delete formatSink;
+	if(out && fclose(out) != 0){
+		fprintf(stderr, "ERROR: writing '%s' failed\n", outPath);
+		status = -1;
+	}
+	delete raster;
+	if(status != 0)
+		return status;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("  %llu segments in %.3f s, %.1f MB/s, %.1f%% of samples skipped by bounds\n", static_cast<unsigned long long>(stats.segments), stats.seconds,
+			stats.seconds > 0.0 ? stats.bytesRead / (1024.0 * 1024.0) / stats.seconds : 0.0,
+			100.0 * stats.skipped / samples);
+	printf("  working set %.1f MB of %.1f MB budget: %d bands of %d rows, peak RSS %.1f MB\n",
+			(stats.workingSet + exportBytes) / (1024.0 * 1024.0), memoryBytes / (1024.0 * 1024.0), stats.bands, stats.bandRows, usage.ru_maxrss / 1024.0);
+	if(outPath){
+		struct stat info;
+		printf("  %s: %.1f MB written, extraction waited %.3f s for the export\n", format,
+				stat(outPath, &info) == 0 ? info.st_size / (1024.0 * 1024.0) : 0.0, stalled);
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef __STREAM_HPP__
+#define __STREAM_HPP__
+
+#include "raster.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Isoline segment in sample coordinates: x in [0, width - 1], y in
+// [0, height - 1] with row 0 at the bottom, as in the grid.
+struct segment_t {
+	float x0, y0;
+	float x1, y1;
+};
+
+// Receives the segments of a streamed contour in batches, in the order the
+// bands were read. The batch is only valid during the call.
+class SegmentSink {
+	public:
+		virtual ~SegmentSink() {}
+
+		// Returns false to stop streaming, e.g. on a write error.
+		virtual bool write(const segment_t *segments, size_t count) = 0;
+		// Called once after the last batch, e.g. to write a footer and flush.
+		virtual bool finish() { return true; }
+};
+
+// Writes segments as raw float32 x0 y0 x1 y1 records in host byte order.
+class RawSegmentSink : public SegmentSink {
+	public:
+		explicit RawSegmentSink(FILE* out) : out(out) {}
+
+		bool write(const segment_t *segments, size_t count);
+
+	private:
+		FILE* out;
+};
+
+struct stream_stats_t {
+	// Working set the budget allows, and the bands it was split into.
+	size_t workingSet;
+	int bandRows;
+	int bands;
+	uint64_t segments;
+	// Sample bytes read from the raster, and samples bounds() let it skip.
+	uint64_t bytesRead;
+	uint64_t skipped;
+	double seconds;
+};
+
+// Smallest budget streamContour() accepts for a raster: two bands of one row.
+size_t minStreamMemory(const Raster &raster);
+
+// Contours the raster at isovalue and its own resolution, one sample per
+// lattice point, and hands the segments to sink as they are found. Rows are
+// read in file order, in bands sized so that a row of values, one batch of
+// segments, the field's cache and two bands of the mapping (the one being
+// contoured and the next, which is prefetched) fit memoryBytes; bands are
+// released once contoured. Runs of a row that the field bounds away from the
+// isoline, e.g. by a tiled container's index, are not read at all. The sink
+// is finished after the last batch. Returns -1 if the budget is too small, a
+// tile of the raster does not decode or the sink failed.
+int streamContour(const Raster &raster, float isovalue, size_t memoryBytes, SegmentSink &sink, stream_stats_t &stats);
+
+// --stream: contours the raster at path into outPath (in format, see
+// createSegmentSink, or only counted when null) and prints the working set and
+// throughput. Returns the process exit status.
+int runStream(const char* path, const char* outPath, const char* format, float isovalue, size_t memoryBytes);
+
+#endif
@@ -0,0 +1,378 @@
+#include "tiled.hpp"
+#include "raster.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static const char* const s_codecNames[] = { "none", "lz4", "zstd", nullptr };
+
+static bool codecAvailable(int codec){
+	switch(codec){
+		case TILE_CODEC_NONE:
+			return true;
+#ifdef HAVE_LZ4
+		case TILE_CODEC_LZ4:
+			return true;
+#endif
+#ifdef HAVE_ZSTD
+		case TILE_CODEC_ZSTD:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+int parseTileCodec(const char* name){
+	for(int i = 0; s_codecNames[i]; i++){
+		if(strcmp(name, s_codecNames[i]) == 0)
+			return codecAvailable(i) ? i : -1;
+	}
+	return -1;
+}
+
+const char* tileCodecName(int codec){
+	return codec >= 0 && codec <= TILE_CODEC_ZSTD ? s_codecNames[codec] : "unknown";
+}
+
+static size_t compressBound(int codec, size_t bytes){
+#ifdef HAVE_LZ4
+	if(codec == TILE_CODEC_LZ4)
+		return LZ4_compressBound(static_cast<int>(bytes));
+#endif
+#ifdef HAVE_ZSTD
+	if(codec == TILE_CODEC_ZSTD)
+		return ZSTD_compressBound(bytes);
+#endif
+	return bytes;
+}
+
+// Returns the stored size, 0 on failure.
+static size_t compressTile(int codec, const uint8_t *src, size_t bytes, uint8_t *dst, size_t capacity){
+#ifdef HAVE_LZ4
+	if(codec == TILE_CODEC_LZ4){
+		int n = LZ4_compress_default(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst), static_cast<int>(bytes), static_cast<int>(capacity));
+		return n > 0 ? static_cast<size_t>(n) : 0;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if(codec == TILE_CODEC_ZSTD){
+		size_t n = ZSTD_compress(dst, capacity, src, bytes, 1);
+		return ZSTD_isError(n) ? 0 : n;
+	}
+#endif
+	memcpy(dst, src, bytes);
+	return bytes;
+}
+
+static bool decompressTile(int codec, const uint8_t *src, size_t stored, uint8_t *dst, size_t bytes){
+#ifdef HAVE_LZ4
+	if(codec == TILE_CODEC_LZ4)
+		return LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst), static_cast<int>(stored), static_cast<int>(bytes)) == static_cast<int>(bytes);
+#endif
+#ifdef HAVE_ZSTD
+	if(codec == TILE_CODEC_ZSTD)
+		return ZSTD_decompress(dst, bytes, src, stored) == bytes;
+#endif
+	if(stored != bytes)
+		return false;
+	memcpy(dst, src, bytes);
+	return true;
+}
+
+TiledField* TiledField::open(const char* path, const uint8_t *data, size_t length){
+	if(length < TILED_HEADER_BYTES || memcmp(data, "MSQT", 4) != 0 || readLE32(data + 4) != 1){
+		fprintf(stderr, "ERROR: '%s' is not a version 1 tiled container\n", path);
+		return nullptr;
+	}
+	const uint32_t w = readLE32(data + 8), h = readLE32(data + 12);
+	const uint32_t tile = readLE32(data + 16), codec = readLE32(data + 20);
+	if(w == 0 || h == 0 || w > INT32_MAX || h > INT32_MAX || tile < 2 || tile > 65536 || (tile & (tile - 1)) != 0){
+		fprintf(stderr, "ERROR: tiled container '%s' has invalid size %ux%u or tile size %u\n", path, w, h, tile);
+		return nullptr;
+	}
+	if(!codecAvailable(codec)){
+		fprintf(stderr, "ERROR: tiled container '%s' uses codec %s, which this build was compiled without\n", path, tileCodecName(codec));
+		return nullptr;
+	}
+
+	TiledField* field = new TiledField();
+	field->data = data;
+	field->width = static_cast<int>(w);
+	field->height = static_cast<int>(h);
+	field->codec = static_cast<int>(codec);
+	field->shift = 0;
+	while((1u << field->shift) < tile)
+		field->shift++;
+	field->tilesX = static_cast<int>((w + tile - 1) / tile);
+	field->tilesY = static_cast<int>((h + tile - 1) / tile);
+	const uint64_t tiles = static_cast<uint64_t>(field->tilesX) * field->tilesY;
+	if(tiles * TILE_ENTRY_BYTES > length - TILED_HEADER_BYTES){
+		fprintf(stderr, "ERROR: tiled container '%s' is truncated in its index\n", path);
+		delete field;
+		return nullptr;
+	}
+
+	field->index.resize(tiles);
+	for(int ty = 0; ty < field->tilesY; ty++){
+		for(int tx = 0; tx < field->tilesX; tx++){
+			const size_t i = static_cast<size_t>(ty) * field->tilesX + tx;
+			const uint8_t *p = data + TILED_HEADER_BYTES + i * TILE_ENTRY_BYTES;
+			entry_t &e = field->index[i];
+			e.offset = readLE64(p);
+			e.bytes = readLE32(p + 8);
+			e.lo = readLE32f(p + 12);
+			e.hi = readLE32f(p + 16);
+			const uint64_t raw = static_cast<uint64_t>(w - tx * tile < tile ? w - tx * tile : tile)
+					* (h - ty * tile < tile ? h - ty * tile : tile) * sizeof(float);
+			if(e.offset > length || e.bytes > length - e.offset || (field->codec == TILE_CODEC_NONE && e.bytes != raw)){
+				fprintf(stderr, "ERROR: tiled container '%s' has a bad index entry for tile %d,%d\n", path, tx, ty);
+				delete field;
+				return nullptr;
+			}
+		}
+	}
+	return field;
+}
+
+int TiledField::getWidth() const {
+	return width;
+}
+
+int TiledField::getHeight() const {
+	return height;
+}
+
+int TiledField::getTileSize() const {
+	return 1 << shift;
+}
+
+int TiledField::getCodec() const {
+	return codec;
+}
+
+size_t TiledField::getCacheBytes() const {
+	if(codec == TILE_CODEC_NONE)
+		return 0;
+	return 2 * static_cast<size_t>(tilesX) * (sizeof(float) << (2 * shift));
+}
+
+uint64_t TiledField::getFailedTiles() const {
+	return failedTiles;
+}
+
+void TiledField::getFileRange(int row0, int row1, size_t &begin, size_t &end) const {
+	// Tiles are stored in index order, so a run of tile rows is contiguous.
+	const entry_t &first = index[static_cast<size_t>(row0 >> shift) * tilesX];
+	const entry_t &last = index[static_cast<size_t>((row1 - 1) >> shift) * tilesX + tilesX - 1];
+	begin = first.offset;
+	end = last.offset + last.bytes;
+}
+
+void TiledField::prefetchRows(int row0, int row1, float isovalue) const {
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	for(int ty = row0 >> shift; ty <= (row1 - 1) >> shift; ty++){
+		const entry_t *e = &index[static_cast<size_t>(ty) * tilesX];
+		for(int tx = 0; tx < tilesX; tx++){
+			if(e[tx].hi < isovalue || e[tx].lo >= isovalue)
+				continue;
+			const size_t begin = e[tx].offset / page * page;
+			madvise(const_cast<uint8_t*>(data) + begin, e[tx].offset + e[tx].bytes - begin, MADV_WILLNEED);
+		}
+	}
+}
+
+void TiledField::tileRow(int tx, int ty, int ry, const uint8_t *&raw, const float *&decoded) const {
+	const int tile = 1 << shift;
+	const int tw = width - (tx << shift) < tile ? width - (tx << shift) : tile;
+	const size_t i = static_cast<size_t>(ty) * tilesX + tx;
+	const entry_t &e = index[i];
+	if(codec == TILE_CODEC_NONE){
+		raw = data + e.offset + static_cast<size_t>(ry) * tw * sizeof(float);
+		decoded = nullptr;
+		return;
+	}
+
+	// Direct mapped on the tile row's parity: a sweep keeps the two rows a
+	// cell row can straddle, random access just decodes a little more.
+	const size_t slot = static_cast<size_t>(ty & 1) * tilesX + tx;
+	if(cache.empty()){
+		cache.resize(getCacheBytes() / sizeof(float));
+		cacheTags.assign(2 * tilesX, -1);
+	}
+	float *dst = cache.data() + (slot << (2 * shift));
+	if(cacheTags[slot] != static_cast<int>(i)){
+		const int th = height - (ty << shift) < tile ? height - (ty << shift) : tile;
+		const size_t samples = static_cast<size_t>(tw) * th;
+		scratch.resize(samples * sizeof(float));
+		if(decompressTile(codec, data + e.offset, e.bytes, scratch.data(), scratch.size())){
+			for(size_t k = 0; k < samples; k++)
+				dst[k] = readLE32f(scratch.data() + k * sizeof(float));
+		} else {
+			fprintf(stderr, "ERROR: tile %d,%d does not decode\n", tx, ty);
+			std::fill(dst, dst + samples, std::numeric_limits<float>::quiet_NaN());
+			failedTiles++;
+		}
+		cacheTags[slot] = static_cast<int>(i);
+	}
+	raw = nullptr;
+	decoded = dst + static_cast<size_t>(ry) * tw;
+}
+
+void TiledField::evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const {
+	const int sy = static_cast<int>(static_cast<int64_t>(row) * height / grid.hQuads);
+	const int ty = sy >> shift;
+	const int ry = sy & ((1 << shift) - 1);
+	const bool native = width == grid.wQuads;
+	auto sampleX = [&](int k){
+		const int x = x0 + k * dx;
+		return native ? x : static_cast<int>(static_cast<int64_t>(x) * width / grid.wQuads);
+	};
+
+	// One tile row lookup per run of samples in the same tile.
+	int k = 0;
+	while(k < count){
+		int sx = sampleX(k);
+		const int tx = sx >> shift;
+		const int base = tx << shift;
+		const int end = base + (1 << shift);
+		const uint8_t *raw;
+		const float *decoded;
+		tileRow(tx, ty, ry, raw, decoded);
+		do {
+			out[k] = raw ? readLE32f(raw + (sx - base) * sizeof(float)) : decoded[sx - base];
+			if(++k == count)
+				break;
+			sx = sampleX(k);
+		} while(sx < end);
+	}
+}
+
+bool TiledField::bounds(const grid_t &grid, int x0, int y0, int x1, int y1, double &lo, double &hi) const {
+	const int tx0 = static_cast<int>(static_cast<int64_t>(x0) * width / grid.wQuads) >> shift;
+	const int tx1 = static_cast<int>(static_cast<int64_t>(x1) * width / grid.wQuads) >> shift;
+	const int ty0 = static_cast<int>(static_cast<int64_t>(y0) * height / grid.hQuads) >> shift;
+	const int ty1 = static_cast<int>(static_cast<int64_t>(y1) * height / grid.hQuads) >> shift;
+	float l = index[static_cast<size_t>(ty0) * tilesX + tx0].lo;
+	float h = index[static_cast<size_t>(ty0) * tilesX + tx0].hi;
+	for(int ty = ty0; ty <= ty1; ty++){
+		const entry_t *e = &index[static_cast<size_t>(ty) * tilesX];
+		for(int tx = tx0; tx <= tx1; tx++){
+			l = e[tx].lo < l ? e[tx].lo : l;
+			h = e[tx].hi > h ? e[tx].hi : h;
+		}
+	}
+	lo = l;
+	hi = h;
+	return true;
+}
+
+uint64_t writeTiled(const Raster &raster, const char* outPath, int tileSize, int codec){
+	FILE* out = fopen(outPath, "wb");
+	if(!out){
+		fprintf(stderr, "ERROR: cannot open '%s' for writing\n", outPath);
+		return 0;
+	}
+
+	const int w = raster.getWidth(), h = raster.getHeight();
+	const int tilesX = (w + tileSize - 1) / tileSize, tilesY = (h + tileSize - 1) / tileSize;
+	std::vector<uint8_t> index(static_cast<size_t>(tilesX) * tilesY * TILE_ENTRY_BYTES, 0);
+	uint8_t header[TILED_HEADER_BYTES] = { 'M', 'S', 'Q', 'T' };
+	writeLE32(header + 4, 1);
+	writeLE32(header + 8, w);
+	writeLE32(header + 12, h);
+	writeLE32(header + 16, tileSize);
+	writeLE32(header + 20, codec);
+	bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header) && fwrite(index.data(), 1, index.size(), out) == index.size();
+
+	// One tile row of field values at a time, converted straight from the source.
+	const grid_t grid = makeGrid(w - 1, h - 1, 1);
+	std::vector<float> band(static_cast<size_t>(tileSize) * w);
+	std::vector<uint8_t> tile(static_cast<size_t>(tileSize) * tileSize * sizeof(float));
+	std::vector<uint8_t> stored(compressBound(codec, tile.size()));
+	uint64_t offset = TILED_HEADER_BYTES + index.size();
+	for(int ty = 0; ty < tilesY && ok; ty++){
+		const int y0 = ty * tileSize;
+		const int th = h - y0 < tileSize ? h - y0 : tileSize;
+		for(int r = 0; r < th; r++)
+			raster.getField().evaluate(grid, y0 + r, 0, 1, w, band.data() + static_cast<size_t>(r) * w);
+		raster.releaseRows(y0, y0 + th);
+
+		for(int tx = 0; tx < tilesX && ok; tx++){
+			const int x0 = tx * tileSize;
+			const int tw = w - x0 < tileSize ? w - x0 : tileSize;
+			float lo = band[x0], hi = band[x0];
+			uint8_t *p = tile.data();
+			for(int r = 0; r < th; r++){
+				const float *line = band.data() + static_cast<size_t>(r) * w + x0;
+				for(int k = 0; k < tw; k++, p += sizeof(float)){
+					lo = line[k] < lo ? line[k] : lo;
+					hi = line[k] > hi ? line[k] : hi;
+					writeLE32f(p, line[k]);
+				}
+			}
+			const size_t bytes = p - tile.data();
+			const size_t n = compressTile(codec, tile.data(), bytes, stored.data(), stored.size());
+			ok = n > 0 && fwrite(stored.data(), 1, n, out) == n;
+
+			uint8_t *e = index.data() + (static_cast<size_t>(ty) * tilesX + tx) * TILE_ENTRY_BYTES;
+			writeLE64(e, offset);
+			writeLE32(e + 8, static_cast<uint32_t>(n));
+			writeLE32f(e + 12, lo);
+			writeLE32f(e + 16, hi);
+			offset += n;
+		}
+	}
+	ok = ok && fseek(out, TILED_HEADER_BYTES, SEEK_SET) == 0 && fwrite(index.data(), 1, index.size(), out) == index.size();
+	ok = fclose(out) == 0 && ok;
+	if(!ok){
+		fprintf(stderr, "ERROR: writing '%s' failed\n", outPath);
+		return 0;
+	}
+	return offset;
+}
+
+int runTile(const char* inPath, const char* outPath, int tileSize, const char* codecName){
+	const int codec = parseTileCodec(codecName);
+	if(codec < 0){
+		fprintf(stderr, "ERROR: unknown tile codec '%s' (this build has:", codecName);
+		for(int i = 0; s_codecNames[i]; i++){
+			if(codecAvailable(i))
+				fprintf(stderr, " %s", s_codecNames[i]);
+		}
+		fprintf(stderr, ")\n");
+		return -1;
+	}
+	if(tileSize < 16 || tileSize > 4096 || (tileSize & (tileSize - 1)) != 0){
+		fprintf(stderr, "ERROR: --tile-size takes a power of two from 16 to 4096\n");
+		return -1;
+	}
+	Raster* raster = openRaster(inPath);
+	if(!raster)
+		return -1;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int w = raster->getWidth(), h = raster->getHeight();
+	const uint64_t bytes = writeTiled(*raster, outPath, tileSize, codec);
+	delete raster;
+	if(bytes == 0)
+		return -1;
+	const int tilesX = (w + tileSize - 1) / tileSize, tilesY = (h + tileSize - 1) / tileSize;
+	const uint64_t raw = static_cast<uint64_t>(w) * h * sizeof(float) + TILED_HEADER_BYTES + static_cast<uint64_t>(tilesX) * tilesY * TILE_ENTRY_BYTES;
+	printf("Tiled: %s, %dx%d in %dx%d tiles of %d, codec %s, %.1f MB (%.0f%% of raw) in %.3f s\n", outPath, w, h,
+			tilesX, tilesY, tileSize, tileCodecName(codec), bytes / (1024.0 * 1024.0), 100.0 * bytes / raw,
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	return 0;
+}
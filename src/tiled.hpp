@@ -0,0 +1,101 @@
+#ifndef __TILED_HPP__
+#define __TILED_HPP__
+
+#include "field.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Raster;
+
+// Tiled container layout (.msqt), all little-endian:
+//   0  char[4] magic "MSQT"
+//   4  uint32  version, 1
+//   8  uint32  width
+//   12 uint32  height
+//   16 uint32  tile size, a power of two
+//   20 uint32  codec (tile_codec_t)
+//   24 uint64  reserved, zero
+//   32 index, one TILE_ENTRY_BYTES entry per tile, tile rows from the bottom:
+//        uint64 offset, uint32 stored bytes, float32 min, float32 max, uint32 zero
+//   then the tiles in index order, each a float32 field (isoline at 1) of
+//   its samples row by row from the bottom, compressed with the codec. Tiles
+//   on the right and top edges are clipped to the grid.
+enum tile_codec_t {
+	TILE_CODEC_NONE = 0,
+	TILE_CODEC_LZ4 = 1,
+	TILE_CODEC_ZSTD = 2
+};
+
+static const size_t TILED_HEADER_BYTES = 32;
+static const size_t TILE_ENTRY_BYTES = 24;
+
+// Returns the codec for "none", "lz4" or "zstd", -1 for anything else or a
+// codec this build was compiled without (see CODECS in the Makefile).
+int parseTileCodec(const char* name);
+const char* tileCodecName(int codec);
+
+// A tiled container mapped in memory. Uncompressed tiles are read in place;
+// compressed ones are decoded on first use into a cache of two tile rows, so a
+// sweep over the rows never decodes a tile twice. bounds() answers from the
+// index alone, so engines that prune with it skip whole tiles without
+// touching, let alone decoding, them. The cache makes it single-threaded.
+class TiledField : public ScalarField {
+	public:
+		// data is the whole file, which must outlive the field. Returns nullptr
+		// if the header or index is malformed.
+		static TiledField* open(const char* path, const uint8_t *data, size_t length);
+
+		void evaluate(const grid_t &grid, int row, int x0, int dx, int count, float *out) const;
+		bool bounds(const grid_t &grid, int x0, int y0, int x1, int y1, double &lo, double &hi) const;
+
+		int getWidth() const;
+		int getHeight() const;
+		int getTileSize() const;
+		int getCodec() const;
+		// Decoded tile cache, zero for uncompressed containers.
+		size_t getCacheBytes() const;
+		// Tile decodes that have failed so far. Those tiles' samples read as
+		// NaN, so anything contoured since the count last changed is wrong.
+		uint64_t getFailedTiles() const;
+		// Bytes [begin, end) of the file holding sample rows [row0, row1).
+		void getFileRange(int row0, int row1, size_t &begin, size_t &end) const;
+		// Starts reading the tiles of sample rows [row0, row1) whose range
+		// includes isovalue; the others are never read.
+		void prefetchRows(int row0, int row1, float isovalue) const;
+
+	private:
+		struct entry_t {
+			uint64_t offset;
+			uint32_t bytes;
+			float lo, hi;
+		};
+
+		TiledField() : failedTiles(0) {}
+		// Row ry of tile (tx, ty), decoded if needed; either raw or decoded is set.
+		void tileRow(int tx, int ty, int ry, const uint8_t *&raw, const float *&decoded) const;
+
+		const uint8_t *data;
+		int width, height;
+		int shift;
+		int codec;
+		int tilesX, tilesY;
+		std::vector<entry_t> index;
+		mutable std::vector<float> cache;
+		mutable std::vector<int> cacheTags;
+		mutable std::vector<uint8_t> scratch;
+		mutable uint64_t failedTiles;
+};
+
+// Writes the raster as a container at outPath, one tile row at a time, in
+// tiles of tileSize samples a side compressed with codec. Returns the bytes
+// written, or 0 on failure.
+uint64_t writeTiled(const Raster &raster, const char* outPath, int tileSize, int codec);
+
+// --tile: rewrites the raster at inPath as a container at outPath, one tile
+// row at a time, and prints its size and how long it took. Returns the
+// process exit status.
+int runTile(const char* inPath, const char* outPath, int tileSize, const char* codecName);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __TRIPLE_BUFFER_HPP__
+#define __TRIPLE_BUFFER_HPP__
+
+#include <atomic>
+
+// Single-producer single-consumer handoff of the latest value. The producer
+// always has a private buffer to fill and the consumer always keeps the last
+// one it acquired; the third sits in the middle and is swapped with a single
+// atomic exchange on either side, so neither thread ever waits. Values the
+// consumer did not pick up in time are overwritten.
+template <typename T>
+class TripleBuffer {
+	public:
+		TripleBuffer() : middle(1), writeIndex(0), readIndex(2) {}
+
+		// Producer side.
+		T& writeBuffer() { return buffers[writeIndex]; }
+		void publish() {
+			writeIndex = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+		}
+
+		// Consumer side: returns true if a newer value was swapped in.
+		bool acquire() {
+			if(!(middle.load(std::memory_order_relaxed) & FRESH))
+				return false;
+			readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX;
+			return true;
+		}
+		T& readBuffer() { return buffers[readIndex]; }
+
+	private:
+		static const int INDEX = 3;
+		static const int FRESH = 4;
+
+		T buffers[3];
+		std::atomic<int> middle;
+		int writeIndex;
+		int readIndex;
+};
+
+#endif
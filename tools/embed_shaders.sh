@@ -0,0 +1,29 @@
+#!/bin/sh
+# Usage: embed_shaders.sh <file.glsl>... > embedded_shaders.hpp
+# Emits every shader as a constexpr raw string plus a name -> source table.
+
+echo "// Generated by tools/embed_shaders.sh, do not edit."
+echo "#ifndef __EMBEDDED_SHADERS_HPP__"
+echo "#define __EMBEDDED_SHADERS_HPP__"
+echo
+echo "struct embedded_shader_t {"
+echo "	const char* name;"
+echo "	const char* code;"
+echo "};"
+echo
+for f in "$@"; do
+	id=$(basename "$f" | tr -c 'A-Za-z0-9\n' '_')
+	printf 'constexpr const char %s[] = R"GLSL(' "$id"
+	cat "$f"
+	echo ')GLSL";'
+	echo
+done
+echo "constexpr embedded_shader_t EMBEDDED_SHADERS[] = {"
+for f in "$@"; do
+	id=$(basename "$f" | tr -c 'A-Za-z0-9\n' '_')
+	echo "	{ \"$(basename "$f")\", $id },"
+done
+echo "	{ nullptr, nullptr }"
+echo "};"
+echo
+echo "#endif"